@@ -1,17 +1,31 @@
 #include "boid.h"
 #include "flocks.h"
 #include "channel.h"
+#include "checkpoint.h"
+#include "pipeline.h"
+#include "runlog.h"
+#include "simclock.h"
+
+#include <string>
 
 // Struct to hold FPS statistics for event handler thread
 struct Stats {
     double peakFPS;
     std::queue<double> lastFrames;
+
+    // Snapshot queue counters, only set when pipelined
+    std::optional<ChannelStats> pipeline;
+
+#ifdef BOIDS_SYCL
+    // Host and device time of GPU steps, only set in GPU execution mode
+    std::optional<OverlapStats> overlap = std::nullopt;
+#endif
 };
 
-void displayResults(double peakFPS, std::queue<double> lastFrames) {
+void displayResults(double peakFPS, std::queue<double> lastFrames, std::optional<ChannelStats> pipeline) {
     // Function to display peak (all time) and average fps (over the last 10 frames)
 
-    double averageFPS;
+    double averageFPS = 0;
     int frameCount = lastFrames.size();
     
     for (; !lastFrames.empty(); lastFrames.pop()) {
@@ -19,10 +33,51 @@ void displayResults(double peakFPS, std::queue<double> lastFrames) {
     }
 
     std::cout << "Peak FPS: " << peakFPS << ", Average FPS (<" << frameCount << " frames): " << averageFPS << "\n";
+
+    // Simulation stalls mean rendering was the bottleneck, render stalls mean simulation was
+    if (pipeline) {
+        std::cout << "Snapshot queue depth: " << pipeline->depth << " (peak " << pipeline->peakDepth << ")" <<
+            ", Simulation stalls: " << pipeline->writeStalls << ", Render stalls: " << pipeline->readStalls << "\n";
+    }
 }
 
+#ifdef BOIDS_SYCL
+void displayOverlap(const OverlapStats& overlap) {
+    // Per step averages, overlapped time is host work done while the device stepped
+
+    if (!overlap.steps) {
+        return;
+    }
+
+    double steps = static_cast<double>(overlap.steps);
+
+    std::cout << "GPU steps: " << overlap.steps << ", Host: " << overlap.hostMs / steps << "ms, Device: " << overlap.deviceMs / steps <<
+        "ms, Overlapped: " << overlap.overlapMs / steps << "ms, Waiting: " << overlap.waitMs / steps << "ms per step\n";
+}
+#endif
+
 // Main function
-int main() {
+// Usage: boids [boids] [pipelined 0/1] [overlap 0/1] [resume checkpoint, - for none] [record run log]
+int main(int argc, char* argv[]) {
+    // Read flock size, whether to simulate on a separate thread from rendering, whether GPU steps run while the host draws,
+    // a checkpoint to resume and a run log to record from command line
+    int flockSize = argc > 1 ? std::stoi(argv[1]) : 500;
+    bool pipelined = argc > 2 && std::stoi(argv[2]) != 0;
+#ifdef BOIDS_SYCL
+    bool overlapped = argc > 3 && std::stoi(argv[3]) != 0;
+#endif
+    std::string resume = argc > 4 && std::string(argv[4]) != "-" ? argv[4] : "";
+    std::string record = argc > 5 ? argv[5] : "";
+
+    // Recorded runs step on this thread so every update and input goes through the recorder in order
+    if (!record.empty() && pipelined) {
+        std::cout << "Recording a run log, stepping without the pipeline\n";
+        pipelined = false;
+    }
+
+    // Checkpoint written with the K key
+    const std::string checkpointPath = "checkpoint.boids";
+
     // Seed and initialize random number generator
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -44,21 +99,22 @@ int main() {
     std::chrono::steady_clock::time_point deltaStart;
     std::chrono::steady_clock::time_point deltaStop;
 
-    double deltaTime = NULL;
+    double deltaTime = 0;
 
     // Initialize FPS trackers
     std::queue<double> lastFrames;
-    double peakFPS;
+    double peakFPS = 0;
 
-    // FPS Limit for debugging with < 15 boids
-    // Without limit, deltaTime is too small and causes unexpected behaviour
+    // FPS Limit, only limits rendering since the simulation steps on a fixed timestep
     // -1 limit is unlimited FPS
     double maxFPS = -1;
     double sleepTime;
 
     // Initialize input variables
     char selectionInput;
+#ifdef BOIDS_SYCL
     char deviceSelectionInput;
+#endif
     bool valid = true;
 
     // Event handler thread and channel
@@ -67,47 +123,63 @@ int main() {
     std::thread handler([window, &rx]() {
         Stats s = rx.read().value();
 
-        displayResults(s.peakFPS, s.lastFrames);
+        displayResults(s.peakFPS, s.lastFrames, s.pipeline);
+
+#ifdef BOIDS_SYCL
+        if (s.overlap) {
+            displayOverlap(*s.overlap);
+        }
+#endif
+
+        // Profile of the whole run
+        if (profiler::enabled() && profiler::writeTrace("trace.json")) {
+            std::cout << "Profile written to trace.json\n";
+        }
         exit(0);
      });
 
     // Initialize sequential flock
-    Flock sequential([&rand_x, &rand_y, &rand_v, &gen](int i) {
+    Flock sequential([&rand_x, &rand_y, &rand_v, &gen](int) {
         return Boid(rand_x(gen), rand_y(gen),
         5.f, // radius
         200.f, // top speed
         sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
         15.f); // visibility
-        }, 2.f, 0.25f, 0.25f, gen, window); // weights (separation, cohesion, alignment), gen, window ptr
+        }, flockSize, 2.f, 0.25f, 0.25f, gen, canvasSize, window); // weights (separation, cohesion, alignment), gen, world dimensions, window ptr
 
     // Initialize CPU parallelized flock
-    //CPUFlock cpu([&rand_x, &rand_y, &rand_v, &gen](int i) {
+    //CPUFlock cpu([&rand_x, &rand_y, &rand_v, &gen](int) {
     //    return Boid(rand_x(gen), rand_y(gen),
     //    5.f, // radius
     //    200.f, // top speed
     //    sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
     //    15.f); // visibility
-    //    }, 2.f, 0.25f, 0.25f, // weights (separation, cohesion, alignment)
-    //    gen, window, 4); // window ptr, splits, deltaChannel consumer
+    //    }, flockSize, 2.f, 0.25f, 0.25f, // weights (separation, cohesion, alignment)
+    //    gen, canvasSize, window, 4); // world dimensions, window ptr, splits
 
     // Initialize naively CPU parallelized flock
-    NaiveCPUFlock cpu([&rand_x, &rand_y, &rand_v, &gen](int i) {
+    NaiveCPUFlock cpu([&rand_x, &rand_y, &rand_v, &gen](int) {
         return Boid(rand_x(gen), rand_y(gen),
         5.f, // radius
         200.f, // top speed
         sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
         15.f); // visibility
-        }, 2.f, 0.25f, 0.25f, gen, window, 32);
+        }, flockSize, 2.f, 0.25f, 0.25f, gen, canvasSize, window, 0); // 0 threads, one worker per hardware thread
 
-    // Initialize CPU parallelised flock
-    GPUFlock gpu([&rand_x, &rand_y, &rand_v, &gen](int i) {
+#ifdef BOIDS_SYCL
+    // Initialize GPU parallelised flock
+    GPUFlock gpu([&rand_x, &rand_y, &rand_v, &gen](int) {
         return Boid(rand_x(gen), rand_y(gen),
         5.f, // radius
         200.f, // top speed
         sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
         15.f); // visibility
-        }, 2.f, 0.25f, 0.25f, // weights (separation, cohesion, alignment)
-        gen, window); // window ptr
+        }, flockSize, 2.f, 0.25f, 0.25f, // weights (separation, cohesion, alignment)
+        gen, canvasSize, window); // world dimensions, window ptr
+
+    // Leave each step running on the device while the previous one is drawn
+    gpu.overlap = overlapped;
+#endif
 
     // Initialize runtime polymorphic flock
     Flock* flock = nullptr;
@@ -130,9 +202,11 @@ int main() {
         case '1':
             flock = &cpu;
             break;
+#ifdef BOIDS_SYCL
         case '2':
             flock = &gpu;
             break;
+#endif
         default:
             std::cout << "Invalid selection ! Try again !" << std::endl;
             valid = false;
@@ -140,6 +214,7 @@ int main() {
         }
     } while (!valid);
 
+#ifdef BOIDS_SYCL
     // Device selection if GPU execution mode
     if (selectionInput == '2') {
         do {
@@ -171,6 +246,17 @@ int main() {
             }
         } while (!valid);
     }
+#endif
+
+    // Replace the generated flock with the checkpoint's, continuing its run from the saved step
+    if (!resume.empty()) {
+        if (checkpoint::load(*flock, resume)) {
+            std::cout << "Resumed " << flock->size << " boids at step " << flock->step << " from " << resume << "\n";
+        }
+        else {
+            std::cout << "Could not load checkpoint " << resume << ", starting a new flock\n";
+        }
+    }
 
     window->create(sf::VideoMode(canvasSize.x, canvasSize.y),
         title,
@@ -183,11 +269,64 @@ int main() {
     // Request focus to simulation window
     window->requestFocus();
 
+    profiler::nameThread("Main");
+
+    // Log the run from the flock as it is now, seed included, so boids-replay can rerun it
+    std::unique_ptr<RunRecorder> recorder;
+
+    if (!record.empty()) {
+        recorder = std::make_unique<RunRecorder>(record, *flock);
+
+        if (!recorder->good()) {
+            std::cout << "Could not write run log " << record << ", not recording\n";
+            recorder.reset();
+        }
+    }
+
+    // Step through the recorder when recording
+    auto update = [&](double deltaTime) {
+        if (recorder) {
+            recorder->update(*flock, deltaTime);
+        }
+        else {
+            flock->update(deltaTime);
+        }
+    };
+
+    // First update has no deltaTime, letting flocks set up before stepping
+    update(0);
+
+    // Pipelined mode steps the flock on a simulation thread, this thread only draws its snapshots
+    // Otherwise this thread steps the flock on a fixed timestep clock and draws once per frame however many steps ran
+    std::unique_ptr<SimulationPipeline> pipeline;
+    SimulationClock clock(flock->timestep);
+
+    if (pipelined) {
+        pipeline = std::make_unique<SimulationPipeline>(*flock);
+    }
+    else {
+        flock->deferDraw = true;
+    }
+
+    // Statistics sent to the event handler thread on exit
+    auto results = [&]() {
+        Stats s{ peakFPS, lastFrames, pipeline ? std::optional<ChannelStats>(pipeline->stats()) : std::nullopt };
+
+#ifdef BOIDS_SYCL
+        // Only read while this thread steps the flock, a pipeline's simulation thread may be mid step
+        if (flock == &gpu && !pipeline) {
+            s.overlap = gpu.overlapTimes();
+        }
+#endif
+
+        return s;
+    };
+
     // Window loop
     while (window->isOpen())
     {
         // Start delta timer
-        deltaStart = std::chrono::high_resolution_clock::now();
+        deltaStart = std::chrono::steady_clock::now();
         //! [ --- CODE FROM HERE --- ]
 
         // Check for events
@@ -197,11 +336,61 @@ int main() {
             // Event handlers
             switch (event.type) {
             case sf::Event::Closed:
-                tx.write({ peakFPS, lastFrames });
+                tx.write(results());
                 break;
             case sf::Event::KeyPressed:
                 if (event.key.code == sf::Keyboard::Key::Space) {
-                    tx.write({ peakFPS, lastFrames });
+                    tx.write(results());
+                }
+                // Toggle visibility disc overlay
+                else if (event.key.code == sf::Keyboard::Key::V) {
+                    flock->renderer.showVisibility = !flock->renderer.showVisibility;
+                }
+                // Print last frame's profile and write the trace so far
+                else if (event.key.code == sf::Keyboard::Key::P) {
+                    profiler::writeSummary(std::cout);
+
+                    if (profiler::enabled() && profiler::writeTrace("trace.json")) {
+                        std::cout << "Profile written to trace.json\n";
+                    }
+                }
+                // Checkpoint the current step, a pipeline's simulation thread is stopped while saving and restarted after
+                else if (event.key.code == sf::Keyboard::Key::K) {
+                    if (pipeline) {
+                        pipeline.reset();
+                    }
+
+                    if (checkpoint::save(*flock, checkpointPath)) {
+                        std::cout << "Step " << flock->step << " checkpointed to " << checkpointPath << "\n";
+                    }
+                    else {
+                        std::cout << "Could not write checkpoint " << checkpointPath << "\n";
+                    }
+
+                    if (pipelined) {
+                        pipeline = std::make_unique<SimulationPipeline>(*flock);
+                    }
+                }
+                // Toggle one leader per cluster, between steps like checkpoints
+                else if (event.key.code == sf::Keyboard::Key::C) {
+                    if (pipeline) {
+                        pipeline.reset();
+                    }
+
+                    bool perCluster = !flock->leadership.clustered();
+
+                    if (recorder) {
+                        recorder->setPerCluster(*flock, perCluster);
+                    }
+                    else {
+                        flock->setPerCluster(perCluster);
+                    }
+
+                    std::cout << (perCluster ? "One leader per cluster\n" : "One leader for the flock\n");
+
+                    if (pipelined) {
+                        pipeline = std::make_unique<SimulationPipeline>(*flock);
+                    }
                 }
                 break;
             }
@@ -212,19 +401,43 @@ int main() {
 
         //! [ --- GRAPHICS CODE FROM HERE --- ]
 
-        // Update flock with delta time, update function handles first frame (NULL deltaTime)
-        flock->update(deltaTime);
+        if (pipeline) {
+            // Draw the oldest published step while the simulation thread works on the next one
+            std::optional<Snapshot> frame = pipeline->next();
+
+            if (frame) {
+                PROFILE_ZONE("draw");
+                flock->renderer.draw(*frame, *window);
+                pipeline->release(std::move(*frame));
+            }
+        }
+        else {
+            // Spend the last frame's time in fixed steps, then draw the latest state
+            int steps = clock.advance(deltaTime);
+
+            for (int s = 0; s < steps; s++) {
+                update(clock.timestep());
+            }
+
+            flock->draw();
+        }
 
         //! [ --- STOP GRAPHICS CODE HERE --- ]
 
         // Render all queued objects
-        window->display();
+        {
+            PROFILE_ZONE("display");
+            window->display();
+        }
 
         //! [ --- STOP CODE HERE --- ]
 
+        // Close the frame's profile
+        profiler::frame();
+
         // End delta timer and set deltaTime
-        deltaStop = std::chrono::high_resolution_clock::now();
-        deltaTime = std::chrono::duration_cast<std::chrono::milliseconds>(deltaStop - deltaStart).count() / 1000.0;
+        deltaStop = std::chrono::steady_clock::now();
+        deltaTime = std::chrono::duration<double>(deltaStop - deltaStart).count();
 
         // Push new instant FPS to lastFrames and limit to 10 frames in queue
         lastFrames.push(1 / deltaTime);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+
+// Command line options of the non-interactive tools, given as `--key value` pairs
+namespace arguments {
+    // Read argv's pairs into a map from key (without the dashes) to value, later pairs replacing earlier ones with the same key
+    // Empty, after reporting the argument, if one is not a `--key` or has no value
+    inline std::optional<std::map<std::string, std::string>> parse(int argc, char* argv[]) {
+        std::map<std::string, std::string> values;
+
+        for (int a = 1; a < argc; a += 2) {
+            std::string key = argv[a];
+
+            if (key.rfind("--", 0) != 0 || a + 1 >= argc) {
+                std::cerr << "Invalid argument: " << key << "\n";
+                return std::nullopt;
+            }
+
+            values[key.substr(2)] = argv[a + 1];
+        }
+
+        return values;
+    }
+}
@@ -0,0 +1,412 @@
+#include "boid.h"
+#include "flocks.h"
+#include "checkpoint.h"
+#include "trajectory.h"
+#include "arguments.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+// Engine throughput benchmark, non-interactive so results can be tracked across builds and hardware
+// Steps a headless flock through an untimed warm-up, then times every step and reports throughput and step latency percentiles
+// Usage: boids-bench [--engine seq|naivecpu|cpu|sycl] [--boids n] [--threads n, 0 for one per hardware thread,
+//                    for cpu the world's splits per axis, 0 for 4, running 2 * n^2 threads]
+//                    [--world WxH] [--seed n] [--steps n] [--warmup n] [--format json|csv] [--output file] [--trace file]
+//                    [--device default|cpu|gpu, SYCL device of the sycl engine] [--overlap 0|1, sycl steps run while the host works]
+//                    [--snapshots 0|1, take a render snapshot after every step] [--checkpoint file, start from a saved flock]
+//                    [--record file, record every timed step's trajectory]
+// JSON is written to stdout by default, CSV rows are appended to the output file with a header when it is new
+// Builds with BOIDS_PROFILE can write the timed steps' phases as a Chrome trace, one frame per step
+// The sycl engine also reports host, device and overlapped time per step, snapshots give the host work to overlap with
+// A checkpoint replaces the generated flock, its boid count and world override --boids and --world
+// Recording times each step with its frame handed to the trajectory writer, compare with a run without to see its cost
+
+// Benchmark configuration, defaults match the windowed simulation
+struct BenchConfig {
+    std::string engine = "naivecpu";
+    std::string device = "default";
+    bool overlap = false;
+    bool snapshots = false;
+    int boids = 500;
+    unsigned int threads = 0;
+    sf::Vector2u dimensions = sf::Vector2u(1920, 1080);
+    unsigned int seed = 42;
+    int steps = 1000;
+    int warmup = 100;
+    std::string format = "json";
+    std::string output;
+    std::string trace;
+    std::string checkpoint;
+    std::string record;
+};
+
+// Measured results of one run
+struct BenchResult {
+    // Workers actually used, resolved from a thread count of 0
+    unsigned int threads = 0;
+
+    double elapsed = 0;
+    double stepsPerSecond = 0;
+    double nsPerBoidStep = 0;
+
+    // Step latency percentiles in milliseconds
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+
+    // Per step averages of the sycl engine's host, device, overlapped and waiting time in milliseconds
+    double hostMs = 0;
+    double deviceMs = 0;
+    double overlapMs = 0;
+    double waitMs = 0;
+};
+
+bool parseArguments(int argc, char* argv[], BenchConfig& config) {
+    // Read `--key value` pairs, returning false on unknown keys or missing values
+
+    std::optional<std::map<std::string, std::string>> values = arguments::parse(argc, argv);
+
+    if (!values) {
+        return false;
+    }
+
+    for (const std::pair<const std::string, std::string>& value : *values) {
+        const std::string& key = value.first;
+        const std::string& v = value.second;
+
+        if (key == "engine") {
+            config.engine = v;
+            std::transform(config.engine.begin(), config.engine.end(), config.engine.begin(), [](unsigned char c) {
+                return std::tolower(c);
+            });
+        }
+        else if (key == "device") {
+            config.device = v;
+        }
+        else if (key == "overlap") {
+            config.overlap = std::stoi(v) != 0;
+        }
+        else if (key == "snapshots") {
+            config.snapshots = std::stoi(v) != 0;
+        }
+        else if (key == "boids") {
+            config.boids = std::stoi(v);
+        }
+        else if (key == "threads") {
+            config.threads = std::stoul(v);
+        }
+        else if (key == "world") {
+            std::size_t x = v.find('x');
+
+            if (x == std::string::npos) {
+                std::cerr << "World size must be WxH: " << v << "\n";
+                return false;
+            }
+
+            config.dimensions = sf::Vector2u(std::stoul(v.substr(0, x)), std::stoul(v.substr(x + 1)));
+        }
+        else if (key == "seed") {
+            config.seed = std::stoul(v);
+        }
+        else if (key == "steps") {
+            config.steps = std::stoi(v);
+        }
+        else if (key == "warmup") {
+            config.warmup = std::stoi(v);
+        }
+        else if (key == "format") {
+            config.format = v;
+        }
+        else if (key == "output") {
+            config.output = v;
+        }
+        else if (key == "trace") {
+            config.trace = v;
+        }
+        else if (key == "checkpoint") {
+            config.checkpoint = v;
+        }
+        else if (key == "record") {
+            config.record = v;
+        }
+        else {
+            std::cerr << "Unknown option: --" << key << "\n";
+            return false;
+        }
+    }
+
+    if (config.steps < 1 || config.boids < 1 || config.warmup < 0 || (config.format != "json" && config.format != "csv") ||
+        (config.device != "default" && config.device != "cpu" && config.device != "gpu")) {
+        std::cerr << "Invalid configuration\n";
+        return false;
+    }
+
+    return true;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    // Nearest rank percentile of ascending samples
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100 * sorted.size()));
+
+    return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+void writeJSON(std::ostream& out, const BenchConfig& config, const BenchResult& result) {
+    // One object per run, fields in the same order as the CSV columns
+    out << "{\n" <<
+        "  \"engine\": \"" << config.engine << "\",\n" <<
+        "  \"device\": \"" << config.device << "\",\n" <<
+        "  \"overlap\": " << (config.overlap ? "true" : "false") << ",\n" <<
+        "  \"snapshots\": " << (config.snapshots ? "true" : "false") << ",\n" <<
+        "  \"boids\": " << config.boids << ",\n" <<
+        "  \"threads\": " << result.threads << ",\n" <<
+        "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n" <<
+        "  \"simd\": \"" << simd::name(simd::detect()) << "\",\n" <<
+        "  \"world\": [" << config.dimensions.x << ", " << config.dimensions.y << "],\n" <<
+        "  \"seed\": " << config.seed << ",\n" <<
+        "  \"warmup\": " << config.warmup << ",\n" <<
+        "  \"steps\": " << config.steps << ",\n" <<
+        "  \"elapsed\": " << result.elapsed << ",\n" <<
+        "  \"stepsPerSecond\": " << result.stepsPerSecond << ",\n" <<
+        "  \"nsPerBoidStep\": " << result.nsPerBoidStep << ",\n" <<
+        "  \"latencyMs\": { \"p50\": " << result.p50 << ", \"p95\": " << result.p95 << ", \"p99\": " << result.p99 << " },\n" <<
+        "  \"stepMs\": { \"host\": " << result.hostMs << ", \"device\": " << result.deviceMs << ", \"overlap\": " << result.overlapMs <<
+        ", \"wait\": " << result.waitMs << " }\n" <<
+        "}\n";
+}
+
+void writeCSV(std::ostream& out, const BenchConfig& config, const BenchResult& result, bool header) {
+    // One row per run, preceded by a header when starting a new file
+    if (header) {
+        out << "engine,device,overlap,snapshots,boids,threads,hardwareThreads,simd,worldWidth,worldHeight,seed,warmup,steps,elapsed,stepsPerSecond,nsPerBoidStep," <<
+            "p50Ms,p95Ms,p99Ms,hostMs,deviceMs,overlapMs,waitMs\n";
+    }
+
+    out << config.engine << "," << config.device << "," << config.overlap << "," << config.snapshots << "," << config.boids << "," << result.threads << "," << std::thread::hardware_concurrency() << "," <<
+        simd::name(simd::detect()) << "," << config.dimensions.x << "," << config.dimensions.y << "," << config.seed << "," <<
+        config.warmup << "," << config.steps << "," << result.elapsed << "," << result.stepsPerSecond << "," <<
+        result.nsPerBoidStep << "," << result.p50 << "," << result.p95 << "," << result.p99 << "," << result.hostMs << "," <<
+        result.deviceMs << "," << result.overlapMs << "," << result.waitMs << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    if (!parseArguments(argc, argv, config)) {
+        return 1;
+    }
+
+    // Benchmark a checkpointed flock in its own world, no boids are generated since the checkpoint's replace them
+    int generated = config.boids;
+
+    if (!config.checkpoint.empty()) {
+        std::optional<checkpoint::Header> header = checkpoint::inspect(config.checkpoint);
+
+        if (!header) {
+            std::cerr << "Invalid or unreadable checkpoint: " << config.checkpoint << "\n";
+            return 1;
+        }
+
+        config.boids = static_cast<int>(header->boids);
+        config.dimensions = sf::Vector2u(header->width, header->height);
+        generated = 0;
+    }
+
+    // Seeded generator, so a configuration always benchmarks the same initial flock
+    std::mt19937 gen(config.seed);
+
+    // Initialize random distributions
+    std::uniform_real_distribution<float> rand_x(0, config.dimensions.x);
+    std::uniform_real_distribution<float> rand_y(0, config.dimensions.y);
+    std::uniform_real_distribution<float> rand_v(-200, 200);
+
+    auto dna = [&rand_x, &rand_y, &rand_v, &gen](int) {
+        return Boid(rand_x(gen), rand_y(gen),
+        5.f, // radius
+        200.f, // top speed
+        sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
+        15.f); // visibility
+    };
+
+    // Initialize selected engine without a window
+    std::unique_ptr<Flock> flock;
+    BenchResult result;
+    result.threads = 1;
+
+    // Kept to read step timing back, only set for the sycl engine
+#ifdef BOIDS_SYCL
+    GPUFlock* deviceFlock = nullptr;
+#endif
+
+    if (config.engine == "seq") {
+        flock = std::make_unique<Flock>(dna, generated, 2.f, 0.25f, 0.25f, gen, config.dimensions);
+    }
+    else if (config.engine == "naivecpu") {
+        std::unique_ptr<NaiveCPUFlock> cpu = std::make_unique<NaiveCPUFlock>(dna, generated, 2.f, 0.25f, 0.25f, gen, config.dimensions, nullptr, config.threads);
+        result.threads = cpu->workers().size();
+        flock = std::move(cpu);
+    }
+    else if (config.engine == "cpu") {
+        // Thread count is the number of splits per axis, 4 by default like boids-headless
+        // Each of the splits^2 chunks has a look and an update thread, worlds need not divide evenly into splits
+        int splits = config.threads ? config.threads : 4;
+        flock = std::make_unique<CPUFlock>(dna, generated, 2.f, 0.25f, 0.25f, gen, config.dimensions, nullptr, splits);
+        result.threads = splits * splits * 2;
+    }
+#ifdef BOIDS_SYCL
+    else if (config.engine == "sycl") {
+        std::unique_ptr<GPUFlock> gpu = std::make_unique<GPUFlock>(dna, generated, 2.f, 0.25f, 0.25f, gen, config.dimensions);
+
+        // The SYCL CPU device runs the same kernels through the host's OpenCL runtime, without a GPU
+        if (config.device == "cpu") {
+            gpu->setDevice(sycl::device(sycl::cpu_selector_v));
+        }
+        else if (config.device == "gpu") {
+            gpu->setDevice(sycl::device(sycl::gpu_selector_v));
+        }
+        else {
+            gpu->setDevice(sycl::device(sycl::default_selector_v));
+        }
+
+        gpu->overlap = config.overlap;
+        deviceFlock = gpu.get();
+        flock = std::move(gpu);
+    }
+#endif
+    else {
+        std::cerr << "Invalid or unavailable engine: " << config.engine << "\n";
+        return 1;
+    }
+
+    if (!config.checkpoint.empty() && !checkpoint::load(*flock, config.checkpoint)) {
+        std::cerr << "Could not load checkpoint: " << config.checkpoint << "\n";
+        return 1;
+    }
+
+    profiler::nameThread("Main");
+
+    // Engines log events to stdout, discard them while stepping so the report is the only output
+    std::ostringstream discarded;
+    std::streambuf* stdoutBuffer = std::cout.rdbuf(discarded.rdbuf());
+
+    // First frame has no deltaTime, then untimed steps so caches, the grid and neighbour buffers reach steady state
+    flock->update(0);
+
+    for (int s = 0; s < config.warmup; s++) {
+        flock->update(flock->timestep);
+    }
+
+#ifdef BOIDS_SYCL
+    if (deviceFlock) {
+        deviceFlock->resetOverlapTimes();
+    }
+#endif
+
+    std::unique_ptr<TrajectoryRecorder> recorder;
+
+    if (!config.record.empty()) {
+        recorder = std::make_unique<TrajectoryRecorder>(config.record);
+    }
+
+    // Time every step individually for latency percentiles
+    // Snapshots stand in for a renderer preparing each frame, overlapped sycl steps run while they are taken
+    Snapshot frame;
+    std::vector<double> latencies(config.steps);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last = start;
+
+    for (int s = 0; s < config.steps; s++) {
+        flock->update(flock->timestep);
+
+        if (config.snapshots) {
+            flock->snapshot(frame);
+        }
+
+        if (recorder) {
+            recorder->record(*flock);
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        latencies[s] = std::chrono::duration<double, std::milli>(now - last).count();
+        last = now;
+
+        profiler::frame();
+    }
+
+    // Finish a step still running on the device, so its time is counted in the last step's latency and the elapsed time
+#ifdef BOIDS_SYCL
+    if (deviceFlock) {
+        deviceFlock->finish();
+    }
+#endif
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    latencies.back() += std::chrono::duration<double, std::milli>(end - last).count();
+
+    std::cout.rdbuf(stdoutBuffer);
+
+    // Frames still queued are written after the timed steps
+    if (recorder && !recorder->close()) {
+        std::cerr << "Could not write trajectory: " << config.record << "\n";
+        return 1;
+    }
+
+    result.elapsed = std::chrono::duration<double>(end - start).count();
+    result.stepsPerSecond = config.steps / result.elapsed;
+    result.nsPerBoidStep = result.elapsed * 1e9 / (static_cast<double>(config.steps) * flock->size);
+
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 50);
+    result.p95 = percentile(latencies, 95);
+    result.p99 = percentile(latencies, 99);
+
+#ifdef BOIDS_SYCL
+    if (deviceFlock && deviceFlock->overlapTimes().steps) {
+        const OverlapStats& overlap = deviceFlock->overlapTimes();
+        double steps = static_cast<double>(overlap.steps);
+
+        result.hostMs = overlap.hostMs / steps;
+        result.deviceMs = overlap.deviceMs / steps;
+        result.overlapMs = overlap.overlapMs / steps;
+        result.waitMs = overlap.waitMs / steps;
+    }
+#endif
+
+    if (!config.trace.empty() && !profiler::writeTrace(config.trace)) {
+        std::cerr << "Could not open trace file: " << config.trace << "\n";
+        return 1;
+    }
+
+    // Report to stdout, or to the output file (CSV appends so runs accumulate in one table)
+    if (config.output.empty()) {
+        if (config.format == "json") {
+            writeJSON(std::cout, config, result);
+        }
+        else {
+            writeCSV(std::cout, config, result, true);
+        }
+    }
+    else {
+        bool empty = !std::filesystem::exists(config.output) || std::filesystem::is_empty(config.output);
+        std::ofstream out(config.output, config.format == "csv" ? std::ios::app : std::ios::trunc);
+
+        if (!out) {
+            std::cerr << "Could not open output file: " << config.output << "\n";
+            return 1;
+        }
+
+        if (config.format == "json") {
+            writeJSON(out, config, result);
+        }
+        else {
+            writeCSV(out, config, result, empty);
+        }
+    }
+
+    return 0;
+}
@@ -15,79 +15,23 @@ struct Weights {
         sWeight(sWeight), cWeight(cWeight), aWeight(aWeight) {}
 };
 
-struct FlatBoid {
-    float x;
-    float y;
-    float visibilityRadius;
-
-    int id;
-};
-
-class Chunk;
-
+// Initial state of a boid, returned by a flock's 'DNA' callback and unpacked into the flock's FlockState
 class Boid {
-protected:
-    int id;
-
-    // List holding visible boids
-    std::list<Boid*> visible;
-
+public:
     // Boid information
     sf::Vector2f position;
     sf::Vector2f velocity;
-    float defaultTopSpeed;
     float topSpeed;
     float visibility;
 
-    // Steering forces
-    sf::Vector2f separation;
-    sf::Vector2f cohesion;
-    sf::Vector2f alignment;
-
-    // Leadership
-    bool leader = false;
-    float leaderDuration = 1500;
-    float eccentricity;
-
-    std::chrono::steady_clock::time_point leaderTimerStart;
-    std::chrono::steady_clock::time_point leaderTimerStop;
-
     // Render information
     float radius;
-    sf::CircleShape triangle;
-public:
+
     // Default constructor
     Boid();
 
     // Constructor
     Boid(float x, float y, float radius, float topSpeed, sf::Vector2f v = sfvec::ZEROF, float visibility = 5.f);
-
-    // Steering forces
-    void calculateSeparation(const sf::Vector2u& dimensions);
-    void calculateCohesion(const sf::Vector2u& dimensions);
-    void calculateAlignment();
-
-    // Leadership
-    float escapeAcceleration(float t);
-
-    void calculateEccentricity(const sf::Vector2u& dimensions);
-    void attemptEscape(std::mt19937& gen, sf::Vector2u dimensions);
-
-    // Update functions
-    void update(const sf::Vector2u& dimensions, Weights w, std::mt19937& gen);
-    void draw(std::shared_ptr<sf::RenderWindow> window, double deltaTime);
-
-    // Flatten boid into FlatBoid struct for kernel processsing
-    FlatBoid flatten() {
-        return { this->position.x, this->position.y, this->visibility * this->radius, this->id };
-    }
-
-    // Allow Flocks to access private/protected members
-    friend class Flock;
-    friend class NaiveCPUFlock;
-    friend class ChunkedFlock;
-    friend class CPUFlock;
-    friend class GPUFlock;
 };
 
 class Chunk {
@@ -99,8 +43,8 @@ private:
     // Store chunk index/position
     std::pair<int, int> index;
 
-    // List of boids in chunk
-    std::list<Boid*> owned;
+    // List of boid ids in chunk
+    std::list<int> owned;
 public:
     Chunk() : topLeft(0, 0), bottomRight(0, 0), index(std::make_pair(0, 0)) {};
 
@@ -1,8 +1,23 @@
 #pragma once
 
 #include <mutex>
+#include <condition_variable>
 #include <queue>
 #include <optional>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+// Queue occupancy and blocking counters of a channel
+struct ChannelStats {
+    // Items currently queued and the most ever queued at once
+    std::size_t depth = 0;
+    std::size_t peakDepth = 0;
+
+    // Writes that blocked on a full queue and reads that blocked on an empty one
+    std::size_t writeStalls = 0;
+    std::size_t readStalls = 0;
+};
 
 // Item held by both channels
 template<typename T>
@@ -12,8 +27,21 @@ public:
     std::mutex lock;
     std::condition_variable flag;
     bool closed = false;
+
+    // Bounded channels block writers while capacity items are queued, 0 is unbounded
+    std::size_t capacity = 0;
+    std::condition_variable space;
+
+    ChannelStats stats;
 };
 
+template<typename T>
+class Channel;
+
+// Construct a connected (producer, consumer) pair, capacity bounds the queue (0 is unbounded)
+template<typename T>
+std::pair<Channel<T>, Channel<T>> make_channel(std::size_t capacity = 0);
+
 template<typename T>
 class Channel {
 private:
@@ -24,6 +52,21 @@ private:
     Channel(std::shared_ptr<Item<T>> item, bool isProducer) :
         item(std::move(item)), isProducer(isProducer) {}
 
+    // Queue state helpers, the item's lock must be held
+    bool full() const {
+        return this->item->capacity && this->item->queue.size() >= this->item->capacity;
+    }
+
+    void pop(std::optional<T>& data) {
+        // If queue is not empty, set data to front of queue, pop and wake a blocked writer
+        if (!this->item->queue.empty()) {
+            data = std::move(this->item->queue.front());
+            this->item->queue.pop();
+            this->item->stats.depth = this->item->queue.size();
+            this->item->space.notify_one();
+        }
+    }
+
 public:
     // Disable copy constructor, to ensure there is only one of each Channel
     Channel(Channel const&) = delete;
@@ -41,17 +84,32 @@ public:
 
     bool write(T data) {
         // Write data to queue unless wrong channel is used or channel is closed
-        if (this->isProducer && !this->item->closed) {
-            this->item->lock.lock();
-            this->item->queue.push(std::move(data));
-            this->item->flag.notify_one();
-            this->item->lock.unlock();
+        // Blocks while a bounded queue is full
+        if (!this->isProducer) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> spaceLock(this->item->lock);
+
+        if (this->full() && !this->item->closed) {
+            this->item->stats.writeStalls++;
 
-            return true;
+            // Wait until the reader frees a slot or channel closed
+            this->item->space.wait(spaceLock, [this]() {
+                return !this->full() || this->item->closed;
+            });
         }
-        else {
+
+        if (this->item->closed) {
             return false;
         }
+
+        this->item->queue.push(std::move(data));
+        this->item->stats.depth = this->item->queue.size();
+        this->item->stats.peakDepth = std::max(this->item->stats.peakDepth, this->item->stats.depth);
+        this->item->flag.notify_one();
+
+        return true;
     }
 
     std::optional<T> read() {
@@ -61,41 +119,63 @@ public:
         if (!this->isProducer) {
             std::unique_lock<std::mutex> flagLock(this->item->lock);
 
-            // Wait until queue is not empty or channel closed
-            this->item->flag.wait(flagLock, [this]() {
-                return !this->item->queue.empty() || this->item->closed;
-            });
+            if (this->item->queue.empty() && !this->item->closed) {
+                this->item->stats.readStalls++;
 
-            // If queue is not empty, set data to front of queue and pop
-            if (!this->item->queue.empty()) {
-                data = std::move(this->item->queue.front());
-                this->item->queue.pop();
+                // Wait until queue is not empty or channel closed
+                this->item->flag.wait(flagLock, [this]() {
+                    return !this->item->queue.empty() || this->item->closed;
+                });
             }
 
+            this->pop(data);
+
             flagLock.unlock();
         }
 
         return data;
     }
 
+    std::optional<T> tryRead() {
+        // Read data from queue if any is queued (non-blocking)
+        std::optional<T> data;
+
+        if (!this->isProducer) {
+            std::lock_guard<std::mutex> flagLock(this->item->lock);
+
+            this->pop(data);
+        }
+
+        return data;
+    }
+
+    ChannelStats stats() const {
+        // Copy of the counters, consistent with each other
+        std::lock_guard<std::mutex> statsLock(this->item->lock);
+
+        return this->item->stats;
+    }
+
     void close() {
         // Close channel and notify all waiting read calls
         if (this->item) {
             this->item->lock.lock();
             this->item->closed = true;
             this->item->flag.notify_all();
+            this->item->space.notify_all();
             this->item->lock.unlock();
         }
     }
 
     template<typename U>
-    friend std::pair<Channel<U>, Channel<U>> make_channel();
+    friend std::pair<Channel<U>, Channel<U>> make_channel(std::size_t capacity);
 };
 
 template<typename T>
-std::pair<Channel<T>, Channel<T>> make_channel() {
+std::pair<Channel<T>, Channel<T>> make_channel(std::size_t capacity) {
     // make_channel to construct pair of channels in (producer, consumer) order
     std::shared_ptr<Item<T>> itemPtr = std::make_shared<Item<T>>();
+    itemPtr->capacity = capacity;
 
     Channel<T> producer(itemPtr, true);
     Channel<T> consumer(itemPtr, false);
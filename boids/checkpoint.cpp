@@ -0,0 +1,321 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const char magic[8] = { 'B', 'O', 'I', 'D', 'C', 'K', 'P', 'T' };
+    const std::uint32_t byteOrder = 0x01020304;
+
+    // Arrays start on cache lines, like AlignedVector's storage
+    const std::uint64_t alignment = 64;
+
+    std::uint64_t aligned(std::uint64_t offset) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // Call f(array, vector) for every FlockState array in file order, headings are stored separately in the render table
+    template<typename State, typename F>
+    void forEachArray(State& state, F f) {
+        f(checkpoint::X, state.x);
+        f(checkpoint::Y, state.y);
+        f(checkpoint::VX, state.vx);
+        f(checkpoint::VY, state.vy);
+        f(checkpoint::Radius, state.radius);
+        f(checkpoint::Visibility, state.visibility);
+        f(checkpoint::Leader, state.leader);
+        f(checkpoint::Eccentricity, state.eccentricity);
+        f(checkpoint::TopSpeed, state.topSpeed);
+        f(checkpoint::DefaultTopSpeed, state.defaultTopSpeed);
+        f(checkpoint::LeaderSince, state.leaderSince);
+    }
+
+    // Bytes per boid of every array
+    std::uint64_t elementBytes(int array) {
+        switch (array) {
+        case checkpoint::Leader:
+            return sizeof(std::uint8_t);
+        case checkpoint::LeaderSince:
+            return sizeof(std::uint64_t);
+        default:
+            return sizeof(float);
+        }
+    }
+
+    // Whether a header belongs to a checkpoint this build can read
+    bool compatible(const checkpoint::Header& header) {
+        return std::memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == checkpoint::version &&
+            header.byteOrder == byteOrder && header.headerBytes == sizeof(checkpoint::Header) && header.boids <= INT_MAX;
+    }
+
+    // Flush a file's buffers through to the disk, so the rename never publishes a partially written checkpoint
+    bool flushToDisk(std::FILE* file) {
+        if (std::fflush(file) != 0) {
+            return false;
+        }
+
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    // Read only memory map of a whole file, unmapped on destruction
+    class MappedFile {
+    private:
+        const unsigned char* bytes = nullptr;
+        std::uint64_t length = 0;
+
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+    public:
+        explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+            this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+            LARGE_INTEGER size;
+
+            if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &size) || size.QuadPart == 0) {
+                return;
+            }
+
+            this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+            if (!this->mapping) {
+                return;
+            }
+
+            this->bytes = static_cast<const unsigned char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+            this->length = this->bytes ? size.QuadPart : 0;
+#else
+            int descriptor = open(path.c_str(), O_RDONLY);
+
+            if (descriptor < 0) {
+                return;
+            }
+
+            struct stat status;
+
+            if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+                void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+                if (mapped != MAP_FAILED) {
+                    // Arrays are copied front to back once, let the kernel read ahead
+                    madvise(mapped, status.st_size, MADV_SEQUENTIAL);
+
+                    this->bytes = static_cast<const unsigned char*>(mapped);
+                    this->length = status.st_size;
+                }
+            }
+
+            // The mapping keeps the file open
+            close(descriptor);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() {
+#ifdef _WIN32
+            if (this->bytes) {
+                UnmapViewOfFile(this->bytes);
+            }
+
+            if (this->mapping) {
+                CloseHandle(this->mapping);
+            }
+
+            if (this->file != INVALID_HANDLE_VALUE) {
+                CloseHandle(this->file);
+            }
+#else
+            if (this->bytes) {
+                munmap(const_cast<unsigned char*>(this->bytes), this->length);
+            }
+#endif
+        }
+
+        const unsigned char* data() const {
+            return this->bytes;
+        }
+
+        std::uint64_t size() const {
+            return this->length;
+        }
+    };
+}
+
+bool checkpoint::save(Flock& flock, const std::string& path) {
+    // Write the header and arrays to a temporary file next to path, flush it to disk and rename it over path
+
+    flock.readBack();
+
+    PROFILE_ZONE("checkpoint");
+
+    std::uint64_t boids = flock.size;
+
+    Header header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = checkpoint::version;
+    header.byteOrder = byteOrder;
+    header.headerBytes = sizeof(Header);
+    header.flags = flock.leadership.clustered() ? 1 : 0;
+    header.boids = boids;
+    header.seed = flock.seed;
+    header.step = flock.step;
+    header.width = flock.dimensions.x;
+    header.height = flock.dimensions.y;
+    header.sWeight = flock.w.sWeight;
+    header.cWeight = flock.w.cWeight;
+    header.aWeight = flock.w.aWeight;
+    header.leaderDuration = flock.leaderDuration;
+    header.timestep = flock.timestep;
+
+    // Lay the arrays out one after another after the header
+    std::uint64_t offset = sizeof(Header);
+
+    for (int array = 0; array < Arrays; array++) {
+        header.offsets[array] = aligned(offset);
+        offset = header.offsets[array] + boids * elementBytes(array);
+    }
+
+    // Headings live in the render table's structs, gather them into an array
+    std::vector<float> headings(boids);
+
+    for (std::uint64_t i = 0; i < boids; i++) {
+        headings[i] = flock.render[i].heading;
+    }
+
+    std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+
+    if (!file) {
+        return false;
+    }
+
+    bool written = std::fwrite(&header, sizeof(Header), 1, file) == 1;
+    std::uint64_t position = sizeof(Header);
+
+    // Pad up to each array's offset, then write it whole
+    const char padding[alignment] = {};
+
+    auto write = [&](int array, const void* data) {
+        std::uint64_t bytes = boids * elementBytes(array);
+
+        written = written && std::fwrite(padding, 1, header.offsets[array] - position, file) == header.offsets[array] - position;
+        written = written && std::fwrite(data, 1, bytes, file) == bytes;
+        position = header.offsets[array] + bytes;
+    };
+
+    forEachArray(flock.state, [&](int array, const auto& values) {
+        write(array, values.data());
+    });
+
+    write(Heading, headings.data());
+
+    written = written && flushToDisk(file);
+    written = std::fclose(file) == 0 && written;
+
+    // Renaming over the old checkpoint is atomic, readers see either it or the new one whole
+    std::error_code error;
+
+    if (written) {
+        std::filesystem::rename(temporary, path, error);
+    }
+
+    if (!written || error) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<checkpoint::Header> checkpoint::inspect(const std::string& path) {
+    // Read and validate the header only
+
+    std::ifstream file(path, std::ios::binary);
+    Header header;
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)) || !compatible(header)) {
+        return std::nullopt;
+    }
+
+    return header;
+}
+
+bool checkpoint::load(Flock& flock, const std::string& path) {
+    // Validate the mapped file against its header, then copy every array into the flock's storage
+
+    PROFILE_ZONE("checkpoint");
+
+    MappedFile file(path);
+
+    if (!file.data() || file.size() < sizeof(Header)) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, file.data(), sizeof(Header));
+
+    if (!compatible(header)) {
+        return false;
+    }
+
+    // Every array must lie within the file, offsets are checked against the size first so a corrupt offset can not overflow
+    for (int array = 0; array < Arrays; array++) {
+        std::uint64_t bytes = header.boids * elementBytes(array);
+
+        if (header.offsets[array] < sizeof(Header) || header.offsets[array] > file.size() || bytes > file.size() - header.offsets[array]) {
+            return false;
+        }
+    }
+
+    // Finish any work in flight on the old state, engines stepping elsewhere pick the new state up on the next update
+    flock.synchronize();
+
+    int boids = static_cast<int>(header.boids);
+
+    flock.reserve(boids);
+    flock.size = boids;
+
+    forEachArray(flock.state, [&](int array, auto& values) {
+        std::memcpy(values.data(), file.data() + header.offsets[array], header.boids * elementBytes(array));
+    });
+
+    const unsigned char* headings = file.data() + header.offsets[Heading];
+
+    for (int i = 0; i < boids; i++) {
+        std::memcpy(&flock.render[i].heading, headings + i * sizeof(float), sizeof(float));
+    }
+
+    flock.seed = header.seed;
+    flock.step = header.step;
+    flock.setDimensions(sf::Vector2u(header.width, header.height));
+    flock.w = Weights(header.sWeight, header.cWeight, header.aWeight);
+    flock.leaderDuration = header.leaderDuration;
+    flock.timestep = header.timestep;
+    flock.setPerCluster(header.flags & 1);
+
+    return true;
+}
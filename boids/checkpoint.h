@@ -0,0 +1,70 @@
+#pragma once
+
+#include "flocks.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Binary checkpoints of a flock's full simulation state, so long runs can be resumed and restarted from a recorded step
+// A checkpoint is a fixed header followed by every per-boid array as raw values in the writer's byte order, each array starting on a
+// cache line. Loading maps the file and copies each array into the flock's storage with one memcpy, so loading does not
+// parse boid by boid. The random streams are keyed by (seed, boid id, step), so seed and step capture the whole RNG state
+namespace checkpoint {
+    // Format version, bumped whenever the header or array layout changes. Older versions are rejected
+    const std::uint32_t version = 1;
+
+    // Per-boid arrays in file order
+    enum Array {
+        X, Y, VX, VY, Radius, Visibility, Leader, Eccentricity, TopSpeed, DefaultTopSpeed, LeaderSince, Heading,
+        Arrays
+    };
+
+    // Fixed size file header, every field has a fixed width so the layout does not depend on the compiler
+    struct Header {
+        // "BOIDCKPT"
+        char magic[8];
+        std::uint32_t version;
+
+        // 0x01020304 as written, a checkpoint from a machine of the other byte order reads differently and is rejected
+        std::uint32_t byteOrder;
+
+        // sizeof(Header) when written
+        std::uint32_t headerBytes;
+
+        // Bit 0, one leader per cluster
+        std::uint32_t flags;
+
+        std::uint64_t boids;
+        std::uint64_t seed;
+        std::uint64_t step;
+
+        // World dimensions
+        std::uint32_t width;
+        std::uint32_t height;
+
+        // Steering weights and leadership duration
+        float sWeight;
+        float cWeight;
+        float aWeight;
+        float leaderDuration;
+
+        double timestep;
+
+        // Byte offset of each array from the start of the file
+        std::uint64_t offsets[Arrays];
+    };
+
+    // Write the flock's state to path, replacing any existing file only once the whole checkpoint is on disk,
+    // so a crash mid save leaves the previous checkpoint intact. Returns false if the file could not be written
+    bool save(Flock& flock, const std::string& path);
+
+    // Read a checkpoint's header, without the arrays, so a flock can be constructed for its world before loading
+    // Empty if the file can not be opened or is not a checkpoint of this version
+    std::optional<Header> inspect(const std::string& path);
+
+    // Replace the flock's boids, step, seed, weights, world and leadership settings with a checkpoint's
+    // A different world is set through setDimensions, so chunked flocks lay their chunks out for it
+    // Returns false, leaving the flock unchanged, if the file can not be mapped or is not a valid checkpoint of this version
+    bool load(Flock& flock, const std::string& path);
+}
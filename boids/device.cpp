@@ -0,0 +1,340 @@
+#include "device.h"
+
+#include <bit>
+
+#ifdef BOIDS_SYCL
+void DeviceState::allocate(int capacity, sycl::queue& q) {
+    // Device-only allocations, the host only reaches them through explicit copies
+
+    this->x = sycl::malloc_device<float>(capacity, q);
+    this->y = sycl::malloc_device<float>(capacity, q);
+    this->vx = sycl::malloc_device<float>(capacity, q);
+    this->vy = sycl::malloc_device<float>(capacity, q);
+    this->radius = sycl::malloc_device<float>(capacity, q);
+    this->visibility = sycl::malloc_device<float>(capacity, q);
+    this->leader = sycl::malloc_device<std::uint8_t>(capacity, q);
+    this->eccentricity = sycl::malloc_device<float>(capacity, q);
+    this->topSpeed = sycl::malloc_device<float>(capacity, q);
+    this->defaultTopSpeed = sycl::malloc_device<float>(capacity, q);
+    this->leaderSince = sycl::malloc_device<std::uint64_t>(capacity, q);
+    this->heading = sycl::malloc_device<float>(capacity, q);
+}
+
+void DeviceState::release(sycl::queue& q) {
+    // Free every array, freeing nullptr is a no-op so unallocated states can be released
+
+    sycl::free(this->x, q);
+    sycl::free(this->y, q);
+    sycl::free(this->vx, q);
+    sycl::free(this->vy, q);
+    sycl::free(this->radius, q);
+    sycl::free(this->visibility, q);
+    sycl::free(this->leader, q);
+    sycl::free(this->eccentricity, q);
+    sycl::free(this->topSpeed, q);
+    sycl::free(this->defaultTopSpeed, q);
+    sycl::free(this->leaderSince, q);
+    sycl::free(this->heading, q);
+
+    *this = DeviceState();
+}
+
+void DeviceState::upload(const FlockState& state, const std::vector<BoidRender>& render, int count, sycl::queue& q) {
+    // Queue a copy of every array, then wait for all of them at once
+
+    std::vector<float> headings(count);
+
+    for (int i = 0; i < count; i++) {
+        headings[i] = render[i].heading;
+    }
+
+    q.memcpy(this->x, state.x.data(), count * sizeof(float));
+    q.memcpy(this->y, state.y.data(), count * sizeof(float));
+    q.memcpy(this->vx, state.vx.data(), count * sizeof(float));
+    q.memcpy(this->vy, state.vy.data(), count * sizeof(float));
+    q.memcpy(this->radius, state.radius.data(), count * sizeof(float));
+    q.memcpy(this->visibility, state.visibility.data(), count * sizeof(float));
+    q.memcpy(this->leader, state.leader.data(), count * sizeof(std::uint8_t));
+    q.memcpy(this->eccentricity, state.eccentricity.data(), count * sizeof(float));
+    q.memcpy(this->topSpeed, state.topSpeed.data(), count * sizeof(float));
+    q.memcpy(this->defaultTopSpeed, state.defaultTopSpeed.data(), count * sizeof(float));
+    q.memcpy(this->leaderSince, state.leaderSince.data(), count * sizeof(std::uint64_t));
+    q.memcpy(this->heading, headings.data(), count * sizeof(float));
+    q.wait();
+}
+
+void DeviceState::download(FlockState& state, std::vector<BoidRender>& render, int count, sycl::queue& q) const {
+    // Reverse of upload
+
+    std::vector<float> headings(count);
+
+    q.memcpy(state.x.data(), this->x, count * sizeof(float));
+    q.memcpy(state.y.data(), this->y, count * sizeof(float));
+    q.memcpy(state.vx.data(), this->vx, count * sizeof(float));
+    q.memcpy(state.vy.data(), this->vy, count * sizeof(float));
+    q.memcpy(state.radius.data(), this->radius, count * sizeof(float));
+    q.memcpy(state.visibility.data(), this->visibility, count * sizeof(float));
+    q.memcpy(state.leader.data(), this->leader, count * sizeof(std::uint8_t));
+    q.memcpy(state.eccentricity.data(), this->eccentricity, count * sizeof(float));
+    q.memcpy(state.topSpeed.data(), this->topSpeed, count * sizeof(float));
+    q.memcpy(state.defaultTopSpeed.data(), this->defaultTopSpeed, count * sizeof(float));
+    q.memcpy(state.leaderSince.data(), this->leaderSince, count * sizeof(std::uint64_t));
+    q.memcpy(headings.data(), this->heading, count * sizeof(float));
+    q.wait();
+
+    for (int i = 0; i < count; i++) {
+        render[i].heading = headings[i];
+    }
+}
+
+void device::exclusiveScan(const int* in, int* out, int count, int* blockSums, sycl::queue& q) {
+    // Reduce then scan, work items own whole blocks so no work group synchronization is needed
+
+    int blocks = scanBlocks(count);
+
+    q.parallel_for(sycl::range<1>(blocks), [=](sycl::id<1> idx) {
+        int first = idx[0] * scanBlock;
+        int last = sycl::min(count, first + scanBlock);
+        int total = 0;
+
+        for (int k = first; k < last; k++) {
+            total += in[k];
+        }
+
+        blockSums[idx[0]] = total;
+    });
+
+    // There are count / scanBlock totals, few enough for one work item
+    q.single_task([=]() {
+        int total = 0;
+
+        for (int b = 0; b < blocks; b++) {
+            int sum = blockSums[b];
+            blockSums[b] = total;
+            total += sum;
+        }
+
+        out[count] = total;
+    });
+
+    // Each element is read before its slot is written, so scanning in place is safe
+    q.parallel_for(sycl::range<1>(blocks), [=](sycl::id<1> idx) {
+        int first = idx[0] * scanBlock;
+        int last = sycl::min(count, first + scanBlock);
+        int total = blockSums[idx[0]];
+
+        for (int k = first; k < last; k++) {
+            int value = in[k];
+            out[k] = total;
+            total += value;
+        }
+    });
+}
+
+void DeviceGrid::reserve(int capacity, sycl::queue& q) {
+    // Grow per-boid buffers, doubling like GPUFlock's
+
+    if (capacity <= this->capacity) {
+        return;
+    }
+
+    int cells = this->cellCapacity;
+    this->release(q);
+    this->capacity = capacity;
+
+    int blocks = (capacity + sortBlock - 1) / sortBlock;
+    int digits = (1 << radixBits) * blocks;
+
+    this->keys = sycl::malloc_device<unsigned int>(capacity, q);
+    this->scratchKeys = sycl::malloc_device<unsigned int>(capacity, q);
+    this->sorted = sycl::malloc_device<int>(capacity, q);
+    this->scratchIds = sycl::malloc_device<int>(capacity, q);
+    this->sortedX = sycl::malloc_device<float>(capacity, q);
+    this->sortedY = sycl::malloc_device<float>(capacity, q);
+    this->histogram = sycl::malloc_device<int>(digits + 1, q);
+    this->blockSums = sycl::malloc_device<int>(device::scanBlocks(digits), q);
+    this->maxReach = sycl::malloc_device<unsigned int>(1, q);
+    this->shape = sycl::malloc_device<GridShape>(1, q);
+
+    // Cell tables are sized by prepare once the grid's shape is known
+    if (cells) {
+        this->cellStart = sycl::malloc_device<int>(cells, q);
+        this->cellEnd = sycl::malloc_device<int>(cells, q);
+        this->cellCapacity = cells;
+    }
+}
+
+void DeviceGrid::release(sycl::queue& q) {
+    // Free every buffer
+
+    sycl::free(this->keys, q);
+    sycl::free(this->scratchKeys, q);
+    sycl::free(this->sorted, q);
+    sycl::free(this->scratchIds, q);
+    sycl::free(this->sortedX, q);
+    sycl::free(this->sortedY, q);
+    sycl::free(this->cellStart, q);
+    sycl::free(this->cellEnd, q);
+    sycl::free(this->histogram, q);
+    sycl::free(this->blockSums, q);
+    sycl::free(this->maxReach, q);
+    sycl::free(this->shape, q);
+
+    *this = DeviceGrid();
+}
+
+void DeviceGrid::sort(int count, sycl::queue& q) {
+    // Each pass counts one digit per sort block, scans the counts into output slots and scatters every block in order
+
+    constexpr int buckets = 1 << radixBits;
+    int blocks = (count + sortBlock - 1) / sortBlock;
+
+    // Passes needed to cover the largest cell key
+    int bits = 0;
+
+    while ((1 << bits) < this->cellCapacity) {
+        bits++;
+    }
+
+    for (int shift = 0; shift < bits; shift += radixBits) {
+        const unsigned int* keysIn = this->keys;
+        const int* idsIn = this->sorted;
+        unsigned int* keysOut = this->scratchKeys;
+        int* idsOut = this->scratchIds;
+        int* histogram = this->histogram;
+
+        // Digit counts of each block, digit major so the scan gives every (digit, block) its first output slot
+        q.parallel_for(sycl::range<1>(blocks), [=](sycl::id<1> idx) {
+            int block = idx[0];
+            int first = block * sortBlock;
+            int last = sycl::min(count, first + sortBlock);
+            int counts[buckets] = {};
+
+            for (int k = first; k < last; k++) {
+                counts[(keysIn[k] >> shift) & (buckets - 1)]++;
+            }
+
+            for (int d = 0; d < buckets; d++) {
+                histogram[d * blocks + block] = counts[d];
+            }
+        });
+
+        device::exclusiveScan(histogram, histogram, buckets * blocks, this->blockSums, q);
+
+        // Blocks scatter their keys in input order, so equal digits keep their order and the sort is stable
+        q.parallel_for(sycl::range<1>(blocks), [=](sycl::id<1> idx) {
+            int block = idx[0];
+            int first = block * sortBlock;
+            int last = sycl::min(count, first + sortBlock);
+            int cursor[buckets];
+
+            for (int d = 0; d < buckets; d++) {
+                cursor[d] = histogram[d * blocks + block];
+            }
+
+            for (int k = first; k < last; k++) {
+                int slot = cursor[(keysIn[k] >> shift) & (buckets - 1)]++;
+
+                keysOut[slot] = keysIn[k];
+                idsOut[slot] = idsIn[k];
+            }
+        });
+
+        // The pass's output is the next pass's input
+        std::swap(this->keys, this->scratchKeys);
+        std::swap(this->sorted, this->scratchIds);
+    }
+}
+
+void DeviceGrid::prepare(const FlockState& state, int count, const sf::Vector2u& dimensions, sycl::queue& q) {
+    // Fit the grid like SpatialGrid, growing cell tables to hold it
+
+    float maxRadius = 1.f;
+
+    for (int i = 0; i < count; i++) {
+        maxRadius = std::max(maxRadius, GridShape::reach(state.radius[i], state.visibility[i], state.leader[i]));
+    }
+
+    this->fallback = GridShape::fit(maxRadius, dimensions);
+
+    // Leaders' visibility may not round trip exactly through the boost, leave room for a slightly smaller reach
+    int cells = GridShape::fit(maxRadius * 0.999f, dimensions).cells();
+
+    if (cells > this->cellCapacity) {
+        this->cellCapacity = std::max(cells, this->cellCapacity * 2);
+
+        sycl::free(this->cellStart, q);
+        sycl::free(this->cellEnd, q);
+
+        this->cellStart = sycl::malloc_device<int>(this->cellCapacity, q);
+        this->cellEnd = sycl::malloc_device<int>(this->cellCapacity, q);
+    }
+}
+
+void DeviceGrid::rebuild(const DeviceState& state, int count, const sf::Vector2u& dimensions, sycl::queue& q) {
+    // Fit the grid, hash boids to cells, sort them by cell and record every cell's range
+
+    unsigned int* maxReach = this->maxReach;
+    GridShape* shape = this->shape;
+    GridShape fallback = this->fallback;
+    int cellCapacity = this->cellCapacity;
+
+    // Cell size follows the largest visibility radius a boid can have, at least 1 like SpatialGrid
+    // Any grid with cells at least that large finds every visible boid, so the fallback shape can stand in
+    q.fill(maxReach, std::bit_cast<unsigned int>(1.f), 1);
+
+    q.parallel_for(sycl::range<1>(count), [=](sycl::id<1> idx) {
+        int i = idx[0];
+        float reach = GridShape::reach(state.radius[i], state.visibility[i], state.leader[i]);
+
+        sycl::atomic_ref<unsigned int, sycl::memory_order::relaxed, sycl::memory_scope::device> best(*maxReach);
+        best.fetch_max(std::bit_cast<unsigned int>(reach));
+    });
+
+    q.single_task([=]() {
+        GridShape fitted = GridShape::fit(std::bit_cast<float>(*maxReach), dimensions);
+
+        *shape = fitted.cells() <= cellCapacity ? fitted : fallback;
+    });
+
+    // Hash every boid to its cell, ids start in ascending order
+    unsigned int* keys = this->keys;
+    int* sorted = this->sorted;
+
+    q.parallel_for(sycl::range<1>(count), [=](sycl::id<1> idx) {
+        int i = idx[0];
+
+        keys[i] = shape->cellIndex(state.x[i], state.y[i]);
+        sorted[i] = i;
+    });
+
+    this->sort(count, q);
+
+    // Gather positions into sorted order and mark where each occupied cell's range starts and ends
+    keys = this->keys;
+    sorted = this->sorted;
+    float* sortedX = this->sortedX;
+    float* sortedY = this->sortedY;
+    int* cellStart = this->cellStart;
+    int* cellEnd = this->cellEnd;
+
+    q.memset(cellStart, 0, cellCapacity * sizeof(int));
+    q.memset(cellEnd, 0, cellCapacity * sizeof(int));
+
+    q.parallel_for(sycl::range<1>(count), [=](sycl::id<1> idx) {
+        int k = idx[0];
+        unsigned int key = keys[k];
+
+        sortedX[k] = state.x[sorted[k]];
+        sortedY[k] = state.y[sorted[k]];
+
+        if (k == 0 || keys[k - 1] != key) {
+            cellStart[key] = k;
+        }
+
+        if (k == count - 1 || keys[k + 1] != key) {
+            cellEnd[key] = k + 1;
+        }
+    });
+}
+#endif
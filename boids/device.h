@@ -0,0 +1,134 @@
+#pragma once
+
+#include "flockstate.h"
+#include "grid.h"
+
+// SYCL device side data structures of GPUFlock, all kept in device USM and reused across steps
+// Work is submitted without waiting in between, so queues passed in must be in order
+#ifdef BOIDS_SYCL
+// Simulation state in device USM, the arrays of a FlockState plus each boid's last defined heading for rendering
+struct DeviceState {
+    float* x = nullptr;
+    float* y = nullptr;
+    float* vx = nullptr;
+    float* vy = nullptr;
+    float* radius = nullptr;
+    float* visibility = nullptr;
+    std::uint8_t* leader = nullptr;
+    float* eccentricity = nullptr;
+    float* topSpeed = nullptr;
+    float* defaultTopSpeed = nullptr;
+    std::uint64_t* leaderSince = nullptr;
+    float* heading = nullptr;
+
+    // Allocate every array for capacity boids, or free them, on the queue's context
+    void allocate(int capacity, sycl::queue& q);
+    void release(sycl::queue& q);
+
+    // Copy count boids from host state and headings, or back into them
+    void upload(const FlockState& state, const std::vector<BoidRender>& render, int count, sycl::queue& q);
+    void download(FlockState& state, std::vector<BoidRender>& render, int count, sycl::queue& q) const;
+
+    // Arrays read by steering
+    StateView view() const {
+        return StateView{ this->x, this->y, this->vx, this->vy, this->leader };
+    }
+};
+
+namespace device {
+
+    // Elements summed and scanned by one work item in exclusiveScan
+    const int scanBlock = 1024;
+
+    // Block totals exclusiveScan needs scratch for when scanning count elements
+    inline int scanBlocks(int count) {
+        return (count + scanBlock - 1) / scanBlock;
+    }
+
+    // Exclusive prefix sum of count ints from in into out (which may be in), writing the total to out[count]
+    // Blocks are summed in parallel, the block totals scanned on one work item and then every block scanned from its offset in parallel,
+    // blockSums must hold scanBlocks(count) ints
+    void exclusiveScan(const int* in, int* out, int count, int* blockSums, sycl::queue& q);
+}
+
+// Uniform grid over the toroidal world built on the device, the device counterpart of SpatialGrid
+// Boids are hashed to cells, radix sorted by cell key and each cell's sorted range is recorded in start and end tables,
+// so a boid's neighbour search only tests the 3x3 cells around it rather than every other boid
+// The sort is stable and starts from id order, so cells hold ascending ids like SpatialGrid's and visible lists built
+// from either grid come out in the same order
+class DeviceGrid {
+private:
+    // Shape of the current step's grid, computed on the device from the boids' reach so building the grid never waits
+    // on a read back, and the shape fitted to the host state on upload, used should the device's not fit the cell tables
+    GridShape* shape = nullptr;
+    GridShape fallback;
+
+    // Cell key and boid id of each sorted slot, sorted in place with scratch buffers for alternate radix passes
+    unsigned int* keys = nullptr;
+    unsigned int* scratchKeys = nullptr;
+    int* sorted = nullptr;
+    int* scratchIds = nullptr;
+
+    // Positions in sorted order, so each cell's coordinates are contiguous
+    float* sortedX = nullptr;
+    float* sortedY = nullptr;
+
+    // Boids in cell c are sorted[cellStart[c]] to sorted[cellEnd[c] - 1], empty cells have equal start and end
+    int* cellStart = nullptr;
+    int* cellEnd = nullptr;
+
+    // Digit counts per sort block of a radix pass, digit major, and the scan's block totals
+    int* histogram = nullptr;
+    int* blockSums = nullptr;
+
+    // Largest reach of any boid as float bits, positive floats order like their bits so it is found with an atomic max
+    unsigned int* maxReach = nullptr;
+
+    // Boids and cells the buffers can hold
+    int capacity = 0;
+    int cellCapacity = 0;
+
+    // Stable LSD radix sort of the first count keys and ids, over enough passes to cover any key below cellCapacity
+    void sort(int count, sycl::queue& q);
+
+public:
+    // Key bits sorted per radix pass, and keys counted and scattered by one work item
+    static const int radixBits = 4;
+    static const int sortBlock = 256;
+
+    // Cell tables and sorted arrays as read by kernels
+    struct View {
+        const GridShape* shape;
+        const int* cellStart;
+        const int* cellEnd;
+        const int* ids;
+        const float* xs;
+        const float* ys;
+
+        // Call callback(begin, end) with the sorted range of every cell in the 3x3 cells around (x, y), in SpatialGrid's order
+        template<typename F>
+        void forEachCell(float x, float y, F callback) const {
+            GridShape shape = *this->shape;
+
+            shape.forEachNeighbour(x, y, [&](int cell) {
+                callback(this->cellStart[cell], this->cellEnd[cell]);
+            });
+        }
+    };
+
+    // Grow per-boid buffers to capacity boids, contents are not preserved
+    void reserve(int capacity, sycl::queue& q);
+    void release(sycl::queue& q);
+
+    // Size cell tables for the grid fitted to the first count boids of host state, after uploading it
+    // Reach only changes on the device through leaders' visibility boost, which it excludes, so tables sized here keep fitting
+    void prepare(const FlockState& state, int count, const sf::Vector2u& dimensions, sycl::queue& q);
+
+    // Queue fitting the grid to the current visibility radii, then bucketing the first count boids into cells
+    void rebuild(const DeviceState& state, int count, const sf::Vector2u& dimensions, sycl::queue& q);
+
+    View view() const {
+        return View{ this->shape, this->cellStart, this->cellEnd, this->sorted, this->sortedX, this->sortedY };
+    }
+};
+#endif
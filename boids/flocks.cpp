@@ -1,89 +1,476 @@
 #include "flocks.h"
 
-void Flock::look(int i) {
-    // Update i-th boid's visible list
+void Flock::reserve(int capacity) {
+    // Reallocate state, step buffer and render table, never shrinking
 
-    // Loop through all boids
-    for (int j = 0; j < this->size; j++) {
-        float relativeDistance = sfvec::getToroidalDistance(this->boids[i].position, this->boids[j].position, this->window->getSize());
+    if (capacity <= this->capacity) {
+        return;
+    }
+
+    this->capacity = capacity;
+
+    this->state.resize(capacity);
+    this->next.resize(capacity);
+    this->render.resize(capacity);
+    this->leadership.resize(capacity);
+}
+
+int Flock::add(const Boid& boid) {
+    // Place boid in the first free slot, doubling capacity when there is none
+
+    this->synchronize();
+
+    if (this->size == this->capacity) {
+        this->reserve(std::max(1, this->capacity * 2));
+    }
+
+    int i = this->size++;
+
+    this->state.set(i, boid);
+    this->render[i] = BoidRender();
+
+    return i;
+}
+
+void Flock::remove(int i) {
+    // Fill the despawned boid's slot with the last boid, keeping live boids contiguous
+    // A despawned leader frees its group's leadership, which is recounted from the state every step
+
+    if (i < 0 || i >= this->size) {
+        return;
+    }
+
+    this->synchronize();
+
+    int last = --this->size;
 
-        // If distance between i-th boid and j-th boid is less than the visibility factor * radius of self, j-th boid is visible
-        if (relativeDistance < (this->boids[i].radius * this->boids[i].visibility) && i != j) {
-            this->boids[i].visible.push_back(&this->boids[j]);
+    if (i != last) {
+        this->state.copy(i, this->state, last);
+        std::swap(this->render[i], this->render[last]);
+    }
+}
+
+void Flock::setPerCluster(bool perCluster) {
+    // Change leadership mode between steps only, like add and remove
+
+    this->synchronize();
+    this->leadership.setPerCluster(perCluster);
+}
+
+void Flock::buildGrid() {
+    // Bucket boids into grid cells at their current positions, must run before look in every step
+    PROFILE_ZONE("grid");
+    this->grid.rebuild(this->state, this->size, this->dimensions);
+}
+
+void Flock::look(int i, int segment) {
+    // Fill i-th boid's visible list in the given neighbour segment
+
+    sf::Vector2f position = this->state.position(i);
+    float visibilityRadius = this->state.radius[i] * this->state.visibility[i];
+    float radiusSquared = visibilityRadius * visibilityRadius;
+
+    // Offsets of visible candidates, cells are tested in blocks so this fits on the stack
+    const int block = 256;
+    int hits[block];
+
+    // Visible boids join the i-th boid's cluster when electing a leader per cluster
+    bool clustered = this->leadership.clustered();
+    int root = clustered ? this->leadership.root(i) : i;
+
+    // Test boids in the 3x3 grid cells around the i-th boid, no other boid can be within its visibility radius
+    this->grid.forEachCell(position, [&](int begin, int end) {
+        for (int first = begin; first < end; first += block) {
+            int count = std::min(block, end - first);
+            int found = this->visibilityKernel(position.x, position.y, radiusSquared, this->grid.xs() + first, this->grid.ys() + first,
+                count, (float)this->dimensions.x, (float)this->dimensions.y, hits);
+
+            // Map hits back to boid ids, skipping self
+            for (int k = 0; k < found; k++) {
+                int j = this->grid.ids()[first + hits[k]];
+
+                if (j != i) {
+                    this->neighbours.add(segment, j);
+
+                    if (clustered) {
+                        root = this->leadership.link(root, j);
+                    }
+                }
+            }
+        }
+    });
+
+    this->neighbours.close(segment, i);
+}
+
+NeighbourSums Flock::accumulateNeighbours(int i, std::span<const int> visible) const {
+    // Walk the visible list once, computing each pair's toroidal offset and distance a single time
+    return steering::accumulate(this->state.view(), i, visible.data(), static_cast<int>(visible.size()), this->dimensions.x, this->dimensions.y);
+}
+
+sf::Vector2f Flock::calculateSeparation(const NeighbourSums& sums) const {
+    // Calculate separation force
+    // The magnitude is scaled by the amount of visible boids * separation weight
+    return steering::separation(sums);
+}
+
+sf::Vector2f Flock::calculateCohesion(int i, const NeighbourSums& sums) const {
+    // Calculate cohesion force, zero if no boids are visible
+    return steering::cohesion(sums, this->state.position(i));
+}
+
+sf::Vector2f Flock::calculateAlignment(const NeighbourSums& sums) const {
+    // Calculate alignment force, following the first visible leader outright
+    return steering::alignment(sums);
+}
+
+void Flock::calculateEccentricity(int i, const NeighbourSums& sums) {
+    // Calculate eccentricity of boid using Felipe Takaoka's eccentricity formula, 0 when no boids are visible
+    this->next.eccentricity[i] = steering::eccentricity(sums, this->state.radius[i], this->state.visibility[i]);
+}
+
+void Flock::attemptEscape(int i, const NeighbourSums& sums) {
+    // Attempt to escape flock with a random chance
+
+    // Get simulated time elapsed since promotion in milliseconds
+    float timeElapsed = steering::leaderTime(this->state.leaderSince[i], this->step, (float)this->timestep);
+
+    if (!this->state.leader[i]) {
+        // Only attempt escape if boids visible (in a flock)
+        if (sums.count > 0) {
+            // Uncomment following lines to display high escape chances for debug
+            //if (this->next.eccentricity[i] > 0.7f) {
+            //    std::cout << "------\n HIGH ECCENTRICITY !" << std::endl;
+            //    std::cout << "eccentricity: " << this->next.eccentricity[i] << std::endl;
+            //    std::cout << "------" << std::endl;
+            //}
+
+            float threshold = steering::escapeThreshold(this->seed, i, this->step);
+
+            // If the boid is at the back of the flock its chance is negative, so it never exceeds the threshold
+            // Only claim leadership, the most eager claim of each leaderless group is promoted once the step is published
+            float escapeChance = steering::escapeChance(sums, this->state.position(i), this->state.velocity(i), this->next.eccentricity[i]);
+
+            if (escapeChance > threshold && this->leadership.available(i)) {
+                this->leadership.claim(i, escapeChance - threshold);
+            }
         }
     }
+    else {
+        // Adjust top speed based on acceleration curve
+        this->next.topSpeed[i] = this->state.defaultTopSpeed[i] * steering::escapeAcceleration(timeElapsed / 1000);
+
+        // If boid has been leader for longer than leaderDuration, reset boid
+        if (timeElapsed > this->leaderDuration) {
+            this->next.leader[i] = false;
+            this->next.topSpeed[i] = this->state.defaultTopSpeed[i];
+            this->next.visibility[i] /= 1.5f;
+        }
+    }
+}
+
+void Flock::promote(int i) {
+    // Make boid i leader in the published state
+
+    // Set boid as leader
+    this->state.leader[i] = true;
+
+    // Adjust boid properties to reflect an escaping boid
+    this->state.visibility[i] *= 1.5f;
+
+    // Start leader timer at the step being published
+    this->state.leaderSince[i] = this->step;
+}
+
+void Flock::steer(int i, std::span<const int> visible) {
+    // Update i-th boid's velocity and leadership in next from the current state
+
+    // Start from the boid's current slot, leadership only changes the fields it updates
+    this->next.copy(i, this->state, i);
+
+    // Gather neighbour totals once for every force
+    NeighbourSums sums = this->accumulateNeighbours(i, visible);
+
+    // Calculate forces
+    sf::Vector2f separation = this->calculateSeparation(sums);
+    sf::Vector2f cohesion = this->calculateCohesion(i, sums);
+    sf::Vector2f alignment = this->calculateAlignment(sums);
+
+    // Leadership
+    this->calculateEccentricity(i, sums);
+    this->attemptEscape(i, sums);
+
+    // Uncomment following lines to print raw steering forces (no weights) for debugging
+    //std::cout << "separation: ";
+    //sfvec::println(separation);
+    //std::cout << "cohesion: ";
+    //sfvec::println(cohesion);
+    //std::cout << "alignment: ";
+    //sfvec::println(alignment);
+
+    // Apply steering forces to velocity with weights, clamped to top speed
+    sf::Vector2f velocity = steering::steer(this->state.velocity(i), separation, cohesion, alignment,
+        this->w.sWeight, this->w.cWeight, this->w.aWeight, this->next.topSpeed[i]);
+
+    // Uncomment next line to print velocity for debugging
+    //sfvec::println(velocity);
+
+    this->next.vx[i] = velocity.x;
+    this->next.vy[i] = velocity.y;
 }
 
-void Flock::forget(int index) {
-    // Clear all boids' visible lists
-    this->boids[index].visible.clear();
+void Flock::move(int i, double deltaTime) {
+    // Integrate the steered velocity into position and handle looping around the world
+    // Kept separate from draw so headless flocks can step without a render window
+
+    sf::Vector2f position = steering::integrate(this->state.position(i), this->next.velocity(i), (float)deltaTime, this->dimensions.x, this->dimensions.y);
+
+    this->next.x[i] = position.x;
+    this->next.y[i] = position.y;
+}
+
+void Flock::swapState() {
+    // Swap buffers, next becomes the current state and the old state is overwritten by the next step
+
+    PROFILE_ZONE("publish");
+
+    std::swap(this->state, this->next);
+    this->step++;
+
+    // Promote this step's escape winners
+    this->leadership.resolve([this](int i) {
+        this->promote(i);
+    });
+}
+
+void Flock::capture(int i, Snapshot& frame) {
+    // Copy i-th boid's render inputs into its slot of a snapshot
+
+    float velocityHeading = sfvec::getRotation(this->state.velocity(i));
+
+    // Keep the last heading if |velocity| = 0
+    if (!isnan(velocityHeading)) {
+        this->render[i].heading = velocityHeading;
+    }
+
+    frame.x[i] = this->state.x[i];
+    frame.y[i] = this->state.y[i];
+    frame.heading[i] = this->render[i].heading;
+    frame.radius[i] = this->state.radius[i];
+    frame.visibilityRadius[i] = this->state.radius[i] * this->state.visibility[i];
+    frame.leader[i] = this->state.leader[i];
+}
+
+void Flock::snapshot(Snapshot& frame) {
+    // Capture every boid of the current state on the calling thread
+    PROFILE_ZONE("snapshot");
+    frame.resize(this->size);
+    frame.step = this->step;
+
+    for (int i = 0; i < this->size; i++) {
+        this->capture(i, frame);
+    }
+}
+
+void Flock::draw() {
+    // Snapshot the current state and render it on the calling thread
+    PROFILE_ZONE("draw");
+    this->snapshot(this->frame);
+    this->renderer.draw(this->frame, *this->window);
 }
 
 void Flock::update(double deltaTime) {
     // Call all necessary frametime functions on all boids
 
     if (deltaTime) {
-        // Loop through all boids
-        for (int i = 0; i < this->size; i++) {
-            // Update i-th boid's visible list
-            this->look(i);
-            // Update i-th boid's forces
-            this->boids[i].update(this->window->getSize(), this->w, this->gen);
-            // Add boid to render queue
-            this->boids[i].draw(this->window, deltaTime);
-            // Clear i-th boid's visible list
-            this->forget(i);
+        this->buildGrid();
+
+        // Update all visible lists
+        this->neighbours.resize(this->size, 1);
+        this->neighbours.beginSegment(0, 0, this->size);
+        this->leadership.begin(this->size);
+
+        {
+            PROFILE_ZONE("look");
+
+            for (int i = 0; i < this->size; i++) {
+                this->look(i, 0);
+            }
+        }
+
+        {
+            PROFILE_ZONE("join");
+            this->neighbours.join();
+            this->leadership.prepare(this->state, this->size);
+        }
+
+        // Loop through all boids, every boid reads only the current state so the order does not matter
+        // Steering includes each boid's escape attempt
+        {
+            PROFILE_ZONE("steer");
+
+            for (int i = 0; i < this->size; i++) {
+                // Update i-th boid's forces and position
+                this->steer(i, this->neighbours.of(i));
+                this->move(i, deltaTime);
+            }
+        }
+
+        this->swapState();
+
+        // Add boids to render queue unless headless or drawn by the caller
+        if (this->drawsFrames()) {
+            this->draw();
         }
     }
 }
 
-void NaiveCPUFlock::boundedUpdate(int lower, int upper) {
-    // Bounded update function adapted to work with multiple threads
+std::pair<int, int> NaiveCPUFlock::bounds(int block) const {
+    // Fixed size blocks, the last block takes the remainder
+
+    int lower = this->blockSize * block;
+    int upper = std::min(lower + this->blockSize, this->size);
+
+    return std::make_pair(lower, upper);
+}
+
+void NaiveCPUFlock::boundedLook(int block) {
+    // Update this block's boids' visible lists in its own neighbour segment
+
+    PROFILE_ZONE("look");
+
+    std::pair<int, int> range = this->bounds(block);
+
+    this->neighbours.beginSegment(block, range.first, range.second);
 
-    // Update this thread's boid's visible lists
-    for (int i = lower; i < upper; i++) {
-        this->look(i);
+    for (int i = range.first; i < range.second; i++) {
+        this->look(i, block);
     }
+}
+
+void NaiveCPUFlock::boundedUpdate(int block, double deltaTime) {
+    // Move this block's neighbour segment into the shared buffer, then steer and move its boids
+
+    PROFILE_ZONE("steer");
 
-    // Make sure all visible lists are updated to prevent data races (updating position while checking distance for visibility check)
-    this->ready.arrive_and_wait();
+    std::pair<int, int> range = this->bounds(block);
 
-    // Call rest of update functions
-    for (int i = lower; i < upper; i++) {
-        this->boids[i].update(this->window->getSize(), this->w, this->gen);
-        this->forget(i);
+    this->neighbours.joinSegment(block);
+
+    for (int i = range.first; i < range.second; i++) {
+        this->steer(i, this->neighbours.of(i));
+        this->move(i, deltaTime);
     }
 }
 
 void NaiveCPUFlock::update(double deltaTime) {
     // Update function adapted to work with multiple threads
 
-    // Run bounded update for every thread, splitting boids evenly(ish)
-    for (int i = 0; i < this->flockThreads.size(); i++) {
-        int sectionSize = this->size / this->flockThreads.size();
+    // No step without deltaTime, like the sequential flock, so both take the same steps from the same updates
+    if (!deltaTime) {
+        return;
+    }
 
-        int lower = sectionSize * i;
-        int upper = (i == this->flockThreads.size() - 1) ? this->size : (sectionSize * (i + 1));
+    // Grid is shared read-only by all threads during look
+    this->buildGrid();
 
-        this->flockThreads[i] = std::thread(&NaiveCPUFlock::boundedUpdate, this, lower, upper);
-    }
+    // One neighbour segment per block, so blocks can be looked at by whichever worker takes them
+    int blocks = this->blocks();
+    this->neighbours.resize(this->size, blocks);
+    this->leadership.begin(this->size);
+
+    // Boids only read the current state and only write their own slot of next, so results do not depend on how blocks
+    // are split between workers
+    // Looking and steering are still separate phases, a block could steer as soon as its own lists are complete
+    // but interleaving the two loops per block measured slower than running each over the whole flock
+    // Blocks are work stolen, a worker landing on a dense cluster does not hold the others up
+    this->pool.runBlocks(blocks, [this](int block) {
+        this->boundedLook(block);
+    });
 
-    // Wait for updates
-    for (std::thread& t : this->flockThreads) {
-        t.join();
+    // Lay out every segment in the shared neighbour buffer and find groups with leaders, then join, steer and move in parallel
+    {
+        PROFILE_ZONE("join");
+        this->neighbours.prepareJoin();
+        this->leadership.prepare(this->state, this->size);
     }
 
+    this->pool.runBlocks(blocks, [this, deltaTime](int block) {
+        this->boundedUpdate(block, deltaTime);
+    });
+
+    this->swapState();
+
     // Draw boids
-    // Handled by main thread since OpenGL context can only be active in one thread at a time,
-    // allowing threads to draw their own boids causes lots of mutex locking and significantly slows down execution
-    for (Boid& boid : this->boids) {
-        boid.draw(this->window, deltaTime);
+    if (this->drawsFrames()) {
+        this->draw();
+    }
+}
+
+void NaiveCPUFlock::snapshot(Snapshot& frame) {
+    // Workers capture their blocks' boids
+    PROFILE_ZONE("snapshot");
+    frame.resize(this->size);
+    frame.step = this->step;
+
+    this->pool.runBlocks(this->blocks(), [this, &frame](int block) {
+        std::pair<int, int> range = this->bounds(block);
+
+        for (int i = range.first; i < range.second; i++) {
+            this->capture(i, frame);
+        }
+    });
+}
+
+void NaiveCPUFlock::draw() {
+    // Workers capture their blocks' boids and write their vertex slices in the same pass,
+    // the draw calls stay on the main thread since the OpenGL context can only be active in one thread at a time
+    PROFILE_ZONE("draw");
+    this->frame.resize(this->size);
+    this->frame.step = this->step;
+    this->renderer.prepare(this->size);
+
+    this->pool.runBlocks(this->blocks(), [this](int block) {
+        std::pair<int, int> range = this->bounds(block);
+
+        PROFILE_ZONE("vertices");
+
+        for (int i = range.first; i < range.second; i++) {
+            this->capture(i, this->frame);
+            this->renderer.write(this->frame, i);
+        }
+    });
+
+    this->renderer.submit(*this->window);
+}
+
+void ChunkedFlock::layoutChunks() {
+    // Divide world area into splits^2 chunks, sized in floats so they cover the whole world
+
+    int splits = static_cast<int>(this->chunks.size());
+    sf::Vector2f chunkSize(static_cast<float>(this->dimensions.x) / splits, static_cast<float>(this->dimensions.y) / splits);
+
+    for (int i = 0; i < splits; i++) {
+        for (int j = 0; j < splits; j++) {
+            sf::Vector2f topLeft(chunkSize.x * i, chunkSize.y * j);
+            sf::Vector2f bottomRight(chunkSize.x * (i + 1), chunkSize.y * (j + 1));
+            this->chunks[i][j] = Chunk(topLeft, bottomRight, std::make_pair(i, j));
+        }
     }
 }
 
+void ChunkedFlock::setDimensions(sf::Vector2u dimensions) {
+    // Chunks are laid out for the old world, lay them out again for the new one
+
+    Flock::setDimensions(dimensions);
+    this->layoutChunks();
+}
+
 void ChunkedFlock::localizeBoids() {
     // Split boids into their respective chunks
 
+    PROFILE_ZONE("localize");
+
     // Clear chunks from previous frame
     for (std::vector<Chunk>& row : this->chunks) {
         for (Chunk& chunk : row) {
@@ -91,20 +478,16 @@ void ChunkedFlock::localizeBoids() {
         }
     }
 
-    // Split boids into chunks using topLeft and bottomRight coordinates
-    for (Boid& boid : this->boids) {
-        for (std::vector<Chunk>& row : this->chunks) {
-            for (Chunk& chunk : row) {
-                if (boid.position.x >= chunk.topLeft.x && boid.position.x <= chunk.bottomRight.x &&
-                    boid.position.y >= chunk.topLeft.y && boid.position.y <= chunk.bottomRight.y)
-                {
-                    chunk.owned.push_back(&boid);
-                    goto next;
-                }
-            }
-        }
-        next:
-            continue;
+    // Split boids into chunks by their position's share of the world, clamped so boids on the far edges
+    // still land in the last chunk when the world does not divide evenly into splits
+    int columns = static_cast<int>(this->chunks.size());
+    int rows = static_cast<int>(this->chunks[0].size());
+
+    for (int i = 0; i < this->size; i++) {
+        int column = std::clamp(static_cast<int>(this->state.x[i] * columns / this->dimensions.x), 0, columns - 1);
+        int row = std::clamp(static_cast<int>(this->state.y[i] * rows / this->dimensions.y), 0, rows - 1);
+
+        this->chunks[column][row].owned.push_back(i);
     }
 }
 
@@ -162,91 +545,599 @@ std::list<std::unique_ptr<Chunk>> ChunkedFlock::getAdjacentChunks(std::pair<int,
     return adjacent;
 }
 
+void CPUFlock::beginSteering() {
+    // Bucket the current state into chunks and release the look threads, update threads steer it after them
+
+    this->localizeBoids();
+    this->neighbours.resize(this->size, 1);
+    this->leadership.begin(this->size);
+    this->leadership.prepare(this->state, this->size);
+
+    {
+        PROFILE_ZONE("barrier");
+        this->lookSync.arrive_and_wait();
+    }
+
+    this->steering = true;
+}
+
+void CPUFlock::endSteering() {
+    // Wait for the update threads to finish steering, they park on updateSync until the next beginSteering
+
+    if (!this->steering) {
+        return;
+    }
+
+    {
+        PROFILE_ZONE("barrier");
+        this->updateSync.arrive_and_wait();
+    }
+
+    this->steering = false;
+}
+
+void CPUFlock::synchronize() {
+    // Steering reads state and writes next while update threads run it, so it must end before the host changes either
+    // Its result is discarded, along with its leadership claims, and the next update steers the changed state again
+
+    if (this->steering) {
+        this->endSteering();
+        this->leadership.resolve([](int) {});
+    }
+}
+
 void CPUFlock::update(double deltaTime) {
-    // Call all necessary frametime functions on all boids
-    std::cout << "new frame\n";
+    // Move boids by the steering started at the end of the previous update, then start steering the next step
 
     if (deltaTime) {
-        std::cout << "deltaTime: " << deltaTime << "\n";
+        // Steering was discarded by host changes since the last update, steer the current state first
+        if (!this->steering) {
+            this->beginSteering();
+        }
 
-        this->updateSync.arrive_and_wait();
+        this->endSteering();
+
+        {
+            PROFILE_ZONE("move");
 
-        for (int i = 0; i < this->size; i++) {
-            this->boids[i].draw(this->window, deltaTime);
+            for (int i = 0; i < this->size; i++) {
+                this->move(i, deltaTime);
+            }
+        }
+
+        this->swapState();
+
+        if (this->drawsFrames()) {
+            this->draw();
         }
     }
 
-    this->localizeBoids();
-    this->lookSync.arrive_and_wait();
-    std::cout << "0th boid's visible boids: " << this->boids[0].visible.size() << "\n";
+    if (!this->steering) {
+        this->beginSteering();
+    }
 }
 
-void GPUFlock::update(double deltaTime) {
-    // Update adapted to work with SYCL DPC++ kernel
+#ifdef BOIDS_SYCL
+void GPUFlock::reserveDevice(int capacity) {
+    // Grow per-boid device buffers to capacity boids, doubling so a growing flock reallocates O(log n) times
+    // Only called by upload, so contents are not preserved
+
+    if (capacity <= this->deviceCapacity) {
+        return;
+    }
+
+    int grown = std::max(capacity, this->deviceCapacity * 2);
+    std::size_t visible = this->visibleCapacity;
+
+    this->releaseDevice();
+    this->deviceCapacity = grown;
+
+    this->deviceState.allocate(this->deviceCapacity, this->q);
+    this->deviceNext.allocate(this->deviceCapacity, this->q);
+    this->deviceGrid.reserve(this->deviceCapacity, this->q);
+
+    this->visibleCounts = sycl::malloc_device<int>(this->deviceCapacity, this->q);
+    this->visibleOffsets = sycl::malloc_device<int>(this->deviceCapacity + 1, this->q);
+    this->scanSums = sycl::malloc_device<int>(device::scanBlocks(this->deviceCapacity), this->q);
+    this->parent = sycl::malloc_device<int>(this->deviceCapacity, this->q);
+    this->led = sycl::malloc_device<int>(this->deviceCapacity, this->q);
+    this->claims = sycl::malloc_device<unsigned long long>(this->deviceCapacity, this->q);
+    this->pairTotal = sycl::malloc_host<int>(1, this->q);
+
+    // Claims are cleared by every resolve, so only start cleared
+    this->q.memset(this->claims, 0, this->deviceCapacity * sizeof(unsigned long long)).wait();
+
+    this->reserveVisible(visible);
+}
+
+void GPUFlock::reserveVisible(std::size_t pairs) {
+    // Grow the visible id buffer to hold pairs ids, doubling like reserveDevice
+
+    if (pairs <= this->visibleCapacity) {
+        return;
+    }
+
+    this->visibleCapacity = std::max(pairs, this->visibleCapacity * 2);
+
+    sycl::free(this->visibleIds, this->q);
+    this->visibleIds = sycl::malloc_device<int>(this->visibleCapacity, this->q);
+}
+
+void GPUFlock::releaseDevice() {
+    // Free every device buffer, they are reallocated on the next update
+
+    this->deviceState.release(this->q);
+    this->deviceNext.release(this->q);
+    this->deviceGrid.release(this->q);
+
+    sycl::free(this->visibleCounts, this->q);
+    sycl::free(this->visibleOffsets, this->q);
+    sycl::free(this->visibleIds, this->q);
+    sycl::free(this->scanSums, this->q);
+    sycl::free(this->parent, this->q);
+    sycl::free(this->led, this->q);
+    sycl::free(this->claims, this->q);
+    sycl::free(this->pairTotal, this->q);
+
+    this->visibleCounts = nullptr;
+    this->visibleOffsets = nullptr;
+    this->visibleIds = nullptr;
+    this->scanSums = nullptr;
+    this->parent = nullptr;
+    this->led = nullptr;
+    this->claims = nullptr;
+    this->pairTotal = nullptr;
+    this->deviceCapacity = 0;
+    this->visibleCapacity = 0;
+    this->resident = false;
+}
+
+void GPUFlock::upload() {
+    // Make the device state current from the host state
+
+    this->reserveDevice(this->size);
+    this->deviceState.upload(this->state, this->render, this->size, this->q);
+    this->deviceGrid.prepare(this->state, this->size, this->dimensions, this->q);
+    this->resident = true;
+
+    // Start with room for a few visible boids each, finish grows the id buffer as lists get longer
+    this->reserveVisible(static_cast<std::size_t>(this->size) * 8);
+}
+
+void GPUFlock::synchronize() {
+    // Copy the device state back, host changes are then uploaded by the next update
+
+    this->finish();
+
+    if (this->resident) {
+        PROFILE_ZONE("synchronize");
+        this->deviceState.download(this->state, this->render, this->size, this->q);
+        this->resident = false;
+    }
+}
+
+std::uint64_t GPUFlock::readBack(bool wait) {
+    // Download without giving up residency, so the next update neither uploads nor rebuilds the device grid
+    // A step left in flight only reads the state published before it, which is copied through the copy queue like snapshots
+
+    if (wait) {
+        this->finish();
+    }
 
-    // Allocate USM pointers
-    FlatBoid* sharedBoids = sycl::malloc_shared<FlatBoid>(this->size, this->q);
-    unsigned int* dimensions = sycl::malloc_shared<unsigned int>(2, this->q);
-    VisibleBoid* visible = sycl::malloc_shared<VisibleBoid>(pow(this->size, 2), this->q);
-    unsigned int* flockSize = sycl::malloc_shared<unsigned int>(1, this->q);
-    unsigned int* counter = sycl::malloc_shared<unsigned int>(1, this->q);
+    if (!this->resident) {
+        return this->step;
+    }
+
+    PROFILE_ZONE("read back");
+
+    if (this->inFlight) {
+        this->deviceNext.download(this->state, this->render, this->size, this->copies);
+        return this->step - 1;
+    }
+
+    this->deviceState.download(this->state, this->render, this->size, this->q);
+    return this->step;
+}
+
+void GPUFlock::buildLists() {
+    // Build every boid's visible list on the device from the device grid, in the host engines' order
+    // The pair total is only known on the device, lists that would overflow the id buffer are left unfilled
+
+    this->deviceGrid.rebuild(this->deviceState, this->size, this->dimensions, this->q);
+
+    DeviceState state = this->deviceState;
+    DeviceGrid::View grid = this->deviceGrid.view();
+    int* counts = this->visibleCounts;
+    int* offsets = this->visibleOffsets;
+    int* ids = this->visibleIds;
+    int size = this->size;
+    std::size_t capacity = this->visibleCapacity;
+    float width = this->dimensions.x;
+    float height = this->dimensions.y;
+
+    // Call visible(other) for every boid in the 3x3 cells around boid i within its visibility radius,
+    // with the same branchless minimum image test as the host's visibility kernels
+    auto search = [=](int i, auto visible) {
+        float x = state.x[i];
+        float y = state.y[i];
+        float visibilityRadius = state.radius[i] * state.visibility[i];
+        float radiusSquared = visibilityRadius * visibilityRadius;
+
+        grid.forEachCell(x, y, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                float dx = sycl::fabs(grid.xs[k] - x);
+                float dy = sycl::fabs(grid.ys[k] - y);
+                dx = sycl::fmin(dx, width - dx);
+                dy = sycl::fmin(dy, height - dy);
+
+                if (dx * dx + dy * dy < radiusSquared && grid.ids[k] != i) {
+                    visible(grid.ids[k]);
+                }
+            }
+        });
+    };
+
+    // Count each boid's visible boids first, so lists are sized to the pairs that exist
+    // Every work item only writes its own count, so no atomics are needed
+    this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+        int count = 0;
+
+        search(idx[0], [&](int) {
+            count++;
+        });
+
+        counts[idx[0]] = count;
+    });
+
+    // Exclusive scan of the counts gives each boid's start in the compacted id buffer,
+    // the total is copied out for finish to check once the step is done
+    device::exclusiveScan(counts, offsets, size, this->scanSums, this->q);
+    this->q.memcpy(this->pairTotal, offsets + size, sizeof(int));
+
+    // Fill each boid's list in its own slice
+    this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+        if (static_cast<std::size_t>(offsets[size]) > capacity) {
+            return;
+        }
+
+        int slot = offsets[idx[0]];
 
-    // Populate USM pointers
-    this->flattenBoids(sharedBoids);
-    sf::Vector2u windowSize = this->window->getSize();
-    dimensions[0] = windowSize.x;
-    dimensions[1] = windowSize.y;
-    *flockSize = this->size;
-    *counter = 0;
+        search(idx[0], [&](int other) {
+            ids[slot++] = other;
+        });
+    });
+}
 
-    q.submit([&](sycl::handler& h) {
-        h.parallel_for(sycl::range<2>(this->size, this->size), [=](sycl::id<2> idx) {
+// Device side union-find over boids, with the same lowest id roots as Leadership so clusters match the host engines
+namespace {
+    using DeviceInt = sycl::atomic_ref<int, sycl::memory_order::relaxed, sycl::memory_scope::device>;
 
-            // Get distances of vector components in each dimension
-            float dx = sycl::abs(sharedBoids[idx[1]].x - sharedBoids[idx[0]].x);
-            float dy = sycl::abs(sharedBoids[idx[1]].y - sharedBoids[idx[0]].y);
+    int findRoot(int* parent, int i) {
+        int p;
 
-            float trueDistance;
+        while ((p = DeviceInt(parent[i]).load()) != i) {
+            i = p;
+        }
 
-            // If the distance is greater than half the dimension's total length,
-            // it is shorter to go the opposite direction, thus the real distance is the dimension - previous distance
-            if (dx > (dimensions[0] / 2)) {
-                dx = dimensions[0] - dx;
+        return i;
+    }
+
+    void linkRoots(int* parent, int a, int b) {
+        // Hang the higher root under the lower one, retrying when another work item re-rooted either first
+        for (;;) {
+            a = findRoot(parent, a);
+            b = findRoot(parent, b);
+
+            if (a == b) {
+                return;
             }
 
-            if (dy > (dimensions[1] / 2)) {
-                dy = dimensions[1] - dy;
+            if (a > b) {
+                std::swap(a, b);
             }
 
-            // set distances array to true distance
-            trueDistance = sycl::sqrt(sycl::pow(dx, (float)2) + sycl::pow(dy, (float)2));
+            int expected = b;
 
-            // Add to visible array if in visibility radius
-            if (trueDistance < sharedBoids[idx[0]].visibilityRadius) {
-                visible[*counter] = { sharedBoids[idx[1]].id, sharedBoids[idx[0]].id };
-                *counter += 1;
+            if (DeviceInt(parent[b]).compare_exchange_strong(expected, a)) {
+                return;
+            }
+        }
+    }
+}
+
+void GPUFlock::prepareLeadership() {
+    // Build clusters from the visible lists when electing per cluster, then flag groups holding a leader
+
+    DeviceState state = this->deviceState;
+    int* offsets = this->visibleOffsets;
+    int* ids = this->visibleIds;
+    int* parent = this->parent;
+    int* led = this->led;
+    int size = this->size;
+    std::size_t capacity = this->visibleCapacity;
+    bool clustered = this->leadership.clustered();
+
+    if (clustered) {
+        this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+            parent[idx[0]] = idx[0];
+        });
+
+        this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+            int i = idx[0];
+
+            if (static_cast<std::size_t>(offsets[size]) > capacity) {
+                return;
+            }
+
+            for (int k = offsets[i]; k < offsets[i + 1]; k++) {
+                linkRoots(parent, i, ids[k]);
             }
         });
-    }).wait();
+    }
 
-    // Loop through visible array and push boids to respective visible lists (excluding 'empty' elements and boids looking at themselves
-    for (int i = 0; i < *counter; i++) {
-        if (visible[i].lookingId != visible[i].visibleId) {
-            this->boids[visible[i].lookingId].visible.push_back(&this->boids[visible[i].visibleId]);
+    this->q.memset(led, 0, (clustered ? size : 1) * sizeof(int));
+
+    this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+        int i = idx[0];
+
+        if (state.leader[i]) {
+            DeviceInt(led[clustered ? findRoot(parent, i) : 0]).store(1);
+        }
+    });
+}
+
+void GPUFlock::stepBoids(double deltaTime) {
+    // Steer, attempt escapes and integrate every boid into the next state, mirroring Flock::steer and Flock::move
+    // Skipped when the lists overflowed, nothing claims leadership and the step is run again
+
+    DeviceState state = this->deviceState;
+    DeviceState next = this->deviceNext;
+    int* offsets = this->visibleOffsets;
+    int* ids = this->visibleIds;
+    int* parent = this->parent;
+    int* led = this->led;
+    unsigned long long* claims = this->claims;
+    int size = this->size;
+    std::size_t capacity = this->visibleCapacity;
+    bool clustered = this->leadership.clustered();
+    Weights w = this->w;
+    std::uint64_t seed = this->seed;
+    std::uint64_t step = this->step;
+    float timestep = (float)this->timestep;
+    float leaderDuration = this->leaderDuration;
+    float dt = (float)deltaTime;
+    float width = this->dimensions.x;
+    float height = this->dimensions.y;
+
+    this->q.parallel_for(sycl::range<1>(size), [=](sycl::id<1> idx) {
+        int i = idx[0];
+
+        if (static_cast<std::size_t>(offsets[size]) > capacity) {
+            return;
+        }
+
+        sf::Vector2f position = state.view().position(i);
+        sf::Vector2f velocity = state.view().velocity(i);
+
+        // Gather neighbour totals once for every force
+        NeighbourSums sums = steering::accumulate(state.view(), i, ids + offsets[i], offsets[i + 1] - offsets[i], width, height);
+
+        sf::Vector2f separation = steering::separation(sums);
+        sf::Vector2f cohesion = steering::cohesion(sums, position);
+        sf::Vector2f alignment = steering::alignment(sums);
+
+        // Leadership
+        float eccentricity = steering::eccentricity(sums, state.radius[i], state.visibility[i]);
+        bool leader = state.leader[i];
+        float visibility = state.visibility[i];
+        float topSpeed = state.topSpeed[i];
+        float timeElapsed = steering::leaderTime(state.leaderSince[i], step, timestep);
+
+        if (!leader) {
+            if (sums.count > 0) {
+                float threshold = steering::escapeThreshold(seed, i, step);
+                float escapeChance = steering::escapeChance(sums, position, velocity, eccentricity);
+                int group = clustered ? findRoot(parent, i) : 0;
+
+                // Claim leadership of a leaderless group, resolved once the step is published
+                if (escapeChance > threshold && !led[group]) {
+                    sycl::atomic_ref<unsigned long long, sycl::memory_order::relaxed, sycl::memory_scope::device> best(claims[group]);
+                    best.fetch_max(steering::claimKey(i, escapeChance - threshold));
+                }
+            }
+        }
+        else {
+            // Adjust top speed based on acceleration curve, then reset once leader for longer than leaderDuration
+            topSpeed = state.defaultTopSpeed[i] * steering::escapeAcceleration(timeElapsed / 1000);
+
+            if (timeElapsed > leaderDuration) {
+                leader = false;
+                topSpeed = state.defaultTopSpeed[i];
+                visibility /= 1.5f;
+            }
+        }
+
+        velocity = steering::steer(velocity, separation, cohesion, alignment, w.sWeight, w.cWeight, w.aWeight, topSpeed);
+
+        sf::Vector2f moved = steering::integrate(position, velocity, dt, width, height);
+
+        next.x[i] = moved.x;
+        next.y[i] = moved.y;
+        next.vx[i] = velocity.x;
+        next.vy[i] = velocity.y;
+        next.radius[i] = state.radius[i];
+        next.visibility[i] = visibility;
+        next.leader[i] = leader;
+        next.eccentricity[i] = eccentricity;
+        next.topSpeed[i] = topSpeed;
+        next.defaultTopSpeed[i] = state.defaultTopSpeed[i];
+        next.leaderSince[i] = state.leaderSince[i];
+
+        // Keep the last heading if |velocity| = 0
+        float heading = sfvec::getRotation(velocity);
+        next.heading[i] = isnan(heading) ? state.heading[i] : heading;
+    });
+}
+
+void GPUFlock::resolveLeadership() {
+    // Promote the winning claim of every claimed group in the published state and clear claims for the next step
+    // The last kernel of a step, its event marks the step's end
+
+    DeviceState state = this->deviceState;
+    unsigned long long* claims = this->claims;
+    std::uint64_t step = this->step;
+
+    this->stepEnd = this->q.parallel_for(sycl::range<1>(this->leadership.clustered() ? this->size : 1), [=](sycl::id<1> idx) {
+        unsigned long long best = claims[idx[0]];
+
+        if (best) {
+            int i = steering::claimant(best);
+
+            state.leader[i] = true;
+            state.visibility[i] *= 1.5f;
+            state.leaderSince[i] = step;
+
+            claims[idx[0]] = 0;
         }
+    });
+}
+
+void GPUFlock::submitStep(double deltaTime) {
+    // Queue the step's kernels, then publish its state so the host moves on while the device works
+
+    PROFILE_ZONE("submit");
+
+    // Empty kernel marking when the device starts the step, for timing
+    this->stepBegin = this->q.single_task([=]() {});
+
+    this->buildLists();
+    this->prepareLeadership();
+    this->stepBoids(deltaTime);
+
+    // Publish the next state and promote this step's escape winners into it
+    std::swap(this->deviceState, this->deviceNext);
+    this->step++;
+
+    this->resolveLeadership();
+
+    this->inFlight = true;
+    this->pendingDelta = deltaTime;
+    this->submitted = std::chrono::steady_clock::now();
+}
+
+void GPUFlock::finish() {
+    // Wait for the step in flight, growing the id buffer and stepping again if its lists did not fit
+
+    if (!this->inFlight) {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+
+    {
+        PROFILE_ZONE("wait");
+        this->stepEnd.wait();
+    }
+
+    std::chrono::steady_clock::time_point waitEnd = std::chrono::steady_clock::now();
+    std::size_t total = *this->pairTotal;
+
+    this->inFlight = false;
+
+    if (total > this->visibleCapacity) {
+        // Only the lists' counts were built, unpublish the untouched state and run the step again with room for every pair
+        std::swap(this->deviceState, this->deviceNext);
+        this->step--;
+
+        this->reserveVisible(total);
+        this->submitStep(this->pendingDelta);
+        this->finish();
+        return;
+    }
+
+    this->record(waitStart, waitEnd);
+
+    // Grow ahead of the lists, so a flock that keeps clustering rarely has to step twice
+    if (total > this->visibleCapacity / 4 * 3) {
+        this->reserveVisible(total + total / 2);
+    }
+}
+
+void GPUFlock::record(std::chrono::steady_clock::time_point waitStart, std::chrono::steady_clock::time_point waitEnd) {
+    // Device time comes from the queue's profiling timestamps, which are on the device's clock, so the step is placed
+    // on the host's clock as ending when the wait returned (or before the wait started, for a wait that returned at once)
+
+    std::uint64_t begin = this->stepBegin.get_profiling_info<sycl::info::event_profiling::command_start>();
+    std::uint64_t end = this->stepEnd.get_profiling_info<sycl::info::event_profiling::command_end>();
+
+    double deviceMs = end > begin ? (end - begin) / 1e6 : 0;
+    double hostMs = std::chrono::duration<double, std::milli>(waitStart - this->submitted).count();
+    double waitMs = std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+
+    // Host work ran from submission until the wait started, the device ran for the last deviceMs before the wait returned
+    this->overlapStats.steps++;
+    this->overlapStats.hostMs += hostMs;
+    this->overlapStats.deviceMs += deviceMs;
+    this->overlapStats.overlapMs += std::max(0.0, std::min(hostMs, deviceMs - waitMs));
+    this->overlapStats.waitMs += waitMs;
+}
+
+void GPUFlock::snapshot(Snapshot& frame) {
+    // Read back only the arrays the renderer draws, radius never changes so it is taken from the host state
+    // While a step is in flight its kernels only read the state before it, so that state is copied without waiting
+
+    if (!this->resident) {
+        Flock::snapshot(frame);
+        return;
     }
 
-    // Run rest of update functions
+    PROFILE_ZONE("snapshot");
+    frame.resize(this->size);
+
+    const DeviceState& published = this->inFlight ? this->deviceNext : this->deviceState;
+    frame.step = this->inFlight ? this->step - 1 : this->step;
+
+    std::vector<float> visibility(this->size);
+
+    this->copies.memcpy(frame.x.data(), published.x, this->size * sizeof(float));
+    this->copies.memcpy(frame.y.data(), published.y, this->size * sizeof(float));
+    this->copies.memcpy(frame.heading.data(), published.heading, this->size * sizeof(float));
+    this->copies.memcpy(frame.leader.data(), published.leader, this->size * sizeof(std::uint8_t));
+    this->copies.memcpy(visibility.data(), published.visibility, this->size * sizeof(float));
+    this->copies.wait();
+
     for (int i = 0; i < this->size; i++) {
-        this->boids[i].update(this->window->getSize(), this->w, this->gen);
-        this->boids[i].draw(this->window, deltaTime);
-        this->forget(i);
-    } 
-
-    // Free USM pointers
-    sycl::free(sharedBoids, this->q);
-    sycl::free(dimensions, this->q);
-    sycl::free(visible, this->q);
-    sycl::free(flockSize, this->q);
-    sycl::free(counter, this->q);
-}
\ No newline at end of file
+        frame.radius[i] = this->state.radius[i];
+        frame.visibilityRadius[i] = this->state.radius[i] * visibility[i];
+    }
+}
+
+void GPUFlock::update(double deltaTime) {
+    // Finish the last step and queue the next, nothing is copied to or from the host
+    // Overlapped, the step is left running and the frame drawn is the one before it
+
+    if (deltaTime) {
+        this->finish();
+
+        // An empty flock has no device buffers to step, only its step count advances like the host engines'
+        if (!this->size) {
+            this->step++;
+        }
+        else {
+            if (!this->resident) {
+                this->upload();
+            }
+
+            this->submitStep(deltaTime);
+
+            if (!this->overlap) {
+                this->finish();
+            }
+        }
+
+        if (this->drawsFrames()) {
+            this->draw();
+        }
+    }
+}
+#endif
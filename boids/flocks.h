@@ -1,48 +1,172 @@
 #pragma once
 
 #include "boid.h"
+#include "flockstate.h"
+#include "grid.h"
+#include "neighbours.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "philox.h"
+#include "leadership.h"
+#include "steering.h"
 #include "channel.h"
+#include "snapshot.h"
+#include "renderer.h"
+#include "profiler.h"
+#include "device.h"
 
 #include <syncstream>
 #include <atomic>
 #include <barrier>
-#include <CL/sycl.hpp>
-
-// Struct to get kernel solutions
-struct VisibleBoid {
-    int visibleId = NULL;
-    int lookingId = NULL;
-};
 
 class Flock {
 public:
-    // Array declaration
-    static const int size = 500;
-    Boid boids[size];
+    // Live boids occupy slots 0 to size - 1 of capacity allocated slots
+    int size = 0;
+    int capacity = 0;
+
+    // Hot simulation state, render-only data is kept in a separate cold table
+    // state is the current step's snapshot and is only read while stepping, every boid writes its own slot of next,
+    // the two are swapped once all boids have stepped so no boid ever sees another's partially updated state
+    FlockState state;
+    FlockState next;
+    std::vector<BoidRender> render;
+
+
+    // Render inputs of the current state and the batched renderer drawing them
+    Snapshot frame;
+    FlockRenderer renderer;
+
+    // Set when the caller draws frames instead of update, so update only steps
+    // Fixed step loops running several steps per frame draw once after them, a SimulationPipeline draws published snapshots
+    bool deferDraw = false;
+
+    // Visible boid ids for each boid, rebuilt every step
+    NeighbourLists neighbours;
 
     // Steering force weights
     Weights w;
 
-    std::mt19937 gen;
+    // Key of the flock's counter-based random streams, a boid's numbers are selected by (seed, boid id, step)
+    // so they can be drawn on any thread without shared generator state
+    std::uint64_t seed = 0;
 
+    // Steps taken, advanced when a step's state is published
+    std::uint64_t step = 0;
+
+    // World dimensions, boids wrap around these edges
+    sf::Vector2u dimensions;
+
+    // Render target, nullptr in headless mode (no draw calls are made)
     std::shared_ptr<sf::RenderWindow> window;
 
-    // Constructor
+    // Neighbour search grid, rebuilt at the start of every step
+    SpatialGrid grid;
+
+    // Vectorized visibility test for the running CPU
+    simd::VisibilityKernel visibilityKernel = simd::visible();
+
+    // Time in milliseconds a boid stays leader after escaping
+    float leaderDuration = 1500;
+
+    // Simulated seconds per step, update must be called with this deltaTime
+    // Leader timers count steps and convert them to time with it, so leadership never reads the wall clock
+    double timestep = 1 / 60.0;
+
+    // Leader election, one leader for the flock or optionally one per cluster
+    Leadership leadership;
+
+    // Constructor, spawning `size` boids with room for `capacity` (at least size) before any reallocation
     template<typename F>
-    Flock(F dna, float sWeight, float cWeight, float aWeight, std::mt19937 gen, std::shared_ptr<sf::RenderWindow> window) :
-        w(sWeight, cWeight, aWeight), gen(gen), window(window) {
-        // Loop through empty array
-        for (int i = 0; i < this->size; i++) {
-            // Assign i-th element to result of 'DNA' callback function, passing the index as an argument
-            this->boids[i] = dna(i);
-            this->boids[i].id = i;
-            this->boids[i].defaultTopSpeed = this->boids[i].topSpeed;
+    Flock(F dna, int size, float sWeight, float cWeight, float aWeight, std::mt19937 gen, sf::Vector2u dimensions, std::shared_ptr<sf::RenderWindow> window = nullptr, int capacity = 0) :
+        w(sWeight, cWeight, aWeight), dimensions(dimensions), window(window) {
+        // Derive the stream key from the caller's generator, so seeding it reproduces the whole run
+        std::uint64_t high = gen();
+        this->seed = (high << 32) | gen();
+
+        this->reserve(std::max(size, capacity));
+
+        // Unpack result of 'DNA' callback function into i-th slot, passing the index as an argument
+        for (int i = 0; i < size; i++) {
+            this->add(dna(i));
         }
     }
 
+    virtual ~Flock() = default;
+
+    // Headless flocks step without a render window
+    bool headless() const {
+        return !this->window;
+    }
+
+    // Update draws each stepped state itself, unless headless or the caller draws frames instead
+    bool drawsFrames() const {
+        return this->window && !this->deferDraw;
+    }
+
+    // Bring state up to date for host access, for engines stepping the flock elsewhere
+    // Called before add, remove and checkpoint loads change state, readBack is enough to only read it
+    virtual void synchronize() {}
+
+    // Change the world's size, only between updates once state is synchronized
+    // Boids outside the new world wrap back into it on their next move
+    virtual void setDimensions(sf::Vector2u dimensions) {
+        this->dimensions = dimensions;
+    }
+
+    // Bring state up to date for host reads only, engines stepping elsewhere keep stepping their own copy
+    // Without wait, a step still in flight is left running and the state published before it is read instead
+    // Returns the step the host state holds
+    virtual std::uint64_t readBack([[maybe_unused]] bool wait = true) {
+        return this->step;
+    }
+
+    // Grow storage to hold at least capacity boids, all per-boid arrays are reallocated together
+    void reserve(int capacity);
+
+    // Spawn a boid in the next free slot and return its id, storage doubles when full so adds are amortized O(1)
+    int add(const Boid& boid);
+
+    // Elect one leader per cluster of mutually visible boids instead of one for the whole flock
+    // Engines stepping elsewhere read the setting while they step, so they are synchronized first
+    void setPerCluster(bool perCluster);
+
+    // Despawn boid i by moving the last boid into its slot, so the last boid's id becomes i
+    // Only call between updates
+    void remove(int index);
+
     // Visibility update functions
-    void look(int index);
-    void forget(int index);
+    void buildGrid();
+    void look(int index, int segment);
+
+    // Single pass over a boid's visible list feeding all steering and leadership terms
+    NeighbourSums accumulateNeighbours(int index, std::span<const int> visible) const;
+
+    // Steering forces
+    sf::Vector2f calculateSeparation(const NeighbourSums& sums) const;
+    sf::Vector2f calculateCohesion(int index, const NeighbourSums& sums) const;
+    sf::Vector2f calculateAlignment(const NeighbourSums& sums) const;
+
+    // Leadership
+    void calculateEccentricity(int index, const NeighbourSums& sums);
+    void attemptEscape(int index, const NeighbourSums& sums);
+    void promote(int index);
+
+    // Per-boid update functions, steer and move read state and write the boid's own slot of next
+    void steer(int index, std::span<const int> visible);
+    void move(int index, double deltaTime);
+
+    // Copy a boid's render inputs into a snapshot, which must already be sized for the flock
+    void capture(int index, Snapshot& frame);
+
+    // Fill a snapshot of the current state, so it can be rendered while the flock keeps stepping
+    virtual void snapshot(Snapshot& frame);
+
+    // Snapshot the current state and submit it to the window
+    virtual void draw();
+
+    // Publish next as the current state once every boid has been stepped, and advance the step counter
+    void swapState();
 
     // TODO inter-thread communication to avoid recalculating collisions!
     // Update function
@@ -51,17 +175,38 @@ public:
 
 class NaiveCPUFlock : public Flock {
 private:
-    std::vector<std::thread> flockThreads;
-    std::barrier<> ready;
+    // Workers persist for the flock's lifetime and are woken once per phase (look, then steer)
+    ThreadPool pool;
 
 public:
+    // Boids per scheduling block, small enough that dense clusters spread over several blocks for idle workers to steal
+    static const int blockSize = 32;
+
+    // threads = 0 uses one worker per hardware thread
     template<typename F>
-    NaiveCPUFlock(F dna, float sWeight, float cWeight, float aWeight, std::mt19937 gen, std::shared_ptr<sf::RenderWindow> window, unsigned int threads) :
-        Flock(dna, sWeight, cWeight, aWeight, gen, window), ready(threads), flockThreads(threads) {}
+    NaiveCPUFlock(F dna, int size, float sWeight, float cWeight, float aWeight, std::mt19937 gen, sf::Vector2u dimensions, std::shared_ptr<sf::RenderWindow> window, unsigned int threads, int capacity = 0) :
+        Flock(dna, size, sWeight, cWeight, aWeight, gen, dimensions, window, capacity), pool(threads) {}
+
+    // Work stealing counters of the flock's workers
+    ThreadPool& workers() {
+        return this->pool;
+    }
+
+    // Number of blocks covering the live boids, and the range of boids in a block
+    int blocks() const {
+        return (this->size + this->blockSize - 1) / this->blockSize;
+    }
+
+    std::pair<int, int> bounds(int block) const;
 
     // Update functions
-    void boundedUpdate(int lower, int upper);
+    void boundedLook(int block);
+    void boundedUpdate(int block, double deltaTime);
     void update(double deltaTime);
+
+    // Snapshots and vertex slices are written by the workers one block at a time
+    void snapshot(Snapshot& frame);
+    void draw();
 };
 
 // Intermediate class between CPUFlock and Flock (originally planned to use chunks in GPU implementation)
@@ -71,22 +216,19 @@ protected:
 public:
     //Constructor
     template<typename F>
-    inline ChunkedFlock(F dna, float sWeight, float cWeight, float aWeight, std::mt19937 gen, std::shared_ptr<sf::RenderWindow> window, const int& splits) :
-        Flock(dna, sWeight, cWeight, aWeight, gen, window)
+    inline ChunkedFlock(F dna, int size, float sWeight, float cWeight, float aWeight, std::mt19937 gen, sf::Vector2u dimensions, std::shared_ptr<sf::RenderWindow> window, const int& splits) :
+        Flock(dna, size, sWeight, cWeight, aWeight, gen, dimensions, window)
     {
         // Initialize chunks vector
         chunks = std::vector<std::vector<Chunk>>(splits, std::vector<Chunk>(splits, Chunk()));
 
-        // Divide window area into splits^2 chunks
-        for (int i = 0; i < splits; i++) {
-            for (int j = 0; j < splits; j++) {
-                sf::Vector2f topLeft((this->window->getSize().x / splits) * i, (this->window->getSize().y / splits) * j);
-                sf::Vector2f bottomRight((this->window->getSize().x / splits) * (i + 1), (this->window->getSize().y / splits) * (j + 1));
-                chunks[i][j] = Chunk(topLeft, bottomRight, std::make_pair(i, j));
-            }
-        }
+        this->layoutChunks();
     }
 
+    // Divide the world into the chunks, again whenever its size changes
+    void layoutChunks();
+    void setDimensions(sf::Vector2u dimensions);
+
     void localizeBoids();
     int countBoids();
 
@@ -106,27 +248,38 @@ private:
     std::barrier<> threadSync;
     std::barrier<> updateSync;
     std::barrier<> lookSync;
+
+    // Shutdown state, lets the destructor walk the worker threads out of their barriers
+    std::atomic<bool> stopping = false;
+
+    // Whether the worker threads are steering the current state, from the end of an update until the next update or
+    // synchronize waits for them
+    bool steering = false;
+
+    void beginSteering();
+    void endSteering();
 public:
     template<typename F>
-    CPUFlock(F dna, float sWeight, float cWeight, float aWeight, std::mt19937 gen, std::shared_ptr<sf::RenderWindow> window, const int& splits) :
-        ChunkedFlock(dna, sWeight, cWeight, aWeight, gen, window, splits), threadSync(pow(this->chunks.size(), 2) * 2), updateSync(pow(this->chunks.size(), 2) + 1), lookSync(pow(this->chunks.size(), 2) + 1)
+    CPUFlock(F dna, int size, float sWeight, float cWeight, float aWeight, std::mt19937 gen, sf::Vector2u dimensions, std::shared_ptr<sf::RenderWindow> window, const int& splits) :
+        ChunkedFlock(dna, size, sWeight, cWeight, aWeight, gen, dimensions, window, splits), threadSync(pow(this->chunks.size(), 2) * 2), updateSync(pow(this->chunks.size(), 2) + 1), lookSync(pow(this->chunks.size(), 2) + 1)
     {
         for (int i = 0; i < splits; i++) {
             for (int j = 0; j < splits; j++) {
-                this->lookThreads.emplace_back([&]() {
+                this->lookThreads.emplace_back([this, i, j]() {
+                    profiler::nameThread("Look " + std::to_string(i) + "," + std::to_string(j));
+
                     for (;;) {
                         this->lookSync.arrive_and_wait();
 
-                        //for (Boid* boid : this->chunks[i][j].owned) {
-                        //    boid->visible.clear();
-                        //}
+                        // Read shutdown state only after lookSync, the destructor sets it while look threads are parked there
+                        bool stop = this->stopping;
 
                         //int chunkWidth = this->chunks[0][0].bottomRight.x - this->chunks[0][0].topLeft.x;
                         //int chunkHeight = this->chunks[0][0].bottomRight.y - this->chunks[0][0].topLeft.y;
 
-                        //for (Boid* boid : this->chunks[i][j].owned) {
+                        //for (int boid : this->chunks[i][j].owned) {
                         //    // Get visibility radius and chunk dimensions
-                        //    int visibilityRadius = std::ceil(boid->visibility * boid->radius);
+                        //    int visibilityRadius = std::ceil(this->state.visibility[boid] * this->state.radius[boid]);
 
                         //    // Define the x and y chunk visibility radius and add 1 for for smoothing
                         //    int chunkXRadius = (visibilityRadius / chunkWidth) + (visibilityRadius % chunkWidth != 0) + 1;
@@ -136,56 +289,213 @@ public:
                         //    std::list<std::unique_ptr<Chunk>> adjacent = this->getAdjacentChunks(std::make_pair(i, j), offsets);
 
                         //    for (std::unique_ptr<Chunk>& chunk : adjacent) {
-                        //        for (Boid* other : chunk->owned) {
-                        //            float relativeDistance = sfvec::getToroidalDistance(boid->position, other->position, this->window->getSize());
+                        //        for (int other : chunk->owned) {
+                        //            float relativeDistance = sfvec::getToroidalDistance(this->state.position(boid), this->state.position(other), this->dimensions);
 
-                        //            if (relativeDistance < visibilityRadius && other->id != boid->id) {
-                        //                boid->visible.push_back(*other);
+                        //            if (relativeDistance < visibilityRadius && other != boid) {
+                        //                this->neighbours.add(segment, other);
                         //            }
                         //        }
                         //    }
                         //}
 
-                        this->threadSync.arrive_and_wait();
+                        {
+                            PROFILE_ZONE("barrier");
+                            this->threadSync.arrive_and_wait();
+                        }
+
+                        if (stop) {
+                            return;
+                        }
                     }
                 });
 
-                this->updateThreads.emplace_back([&]() {
+                this->updateThreads.emplace_back([this, i, j]() {
+                    profiler::nameThread("Update " + std::to_string(i) + "," + std::to_string(j));
+
                     for (;;) {
                         this->threadSync.arrive_and_wait();
 
-                        for (Boid* boid : this->chunks[i][j].owned) {
-                            boid->update(this->window->getSize(), this->w, this->gen);
+                        if (this->stopping) {
+                            return;
+                        }
+
+                        {
+                            PROFILE_ZONE("steer");
+
+                            for (int boid : this->chunks[i][j].owned) {
+                                this->steer(boid, this->neighbours.of(boid));
+                            }
+                        }
+
+                        {
+                            PROFILE_ZONE("barrier");
+                            this->updateSync.arrive_and_wait();
                         }
-                        this->updateSync.arrive_and_wait();
                     }
                 });
             }
         }
     }
 
+    ~CPUFlock() {
+        // Release update threads parked on updateSync (only there while steering),
+        // then release look threads, all threads exit after the next threadSync
+        this->endSteering();
+
+        this->stopping = true;
+        this->lookSync.arrive_and_wait();
+
+        for (std::thread& t : this->lookThreads) {
+            t.join();
+        }
+
+        for (std::thread& t : this->updateThreads) {
+            t.join();
+        }
+    }
+
     //void look(int i, const sf::Vector2u& dimensions);
     void update(double deltaTime);
+
+    // Wait out steering still in flight so add, remove and checkpoint loads can change state and storage
+    void synchronize();
+};
+
+#ifdef BOIDS_SYCL
+// Host and device time spent on GPUFlock's steps, accumulated until reset
+struct OverlapStats {
+    // Steps finished
+    std::uint64_t steps = 0;
+
+    // Host time between submitting a step and waiting for it, device time running its kernels,
+    // and how much of the two coincided in milliseconds
+    double hostMs = 0;
+    double deviceMs = 0;
+    double overlapMs = 0;
+
+    // Host time blocked waiting for steps to finish
+    double waitMs = 0;
 };
 
+// Flock stepped entirely on a SYCL device
+// State is uploaded on the first update and stays resident, every phase of a step (visibility lists, leadership,
+// steering, escape and integration) runs as kernels over it, and only positions, headings and leadership are read back
+// when a snapshot is taken for rendering. Host state is stale while resident, synchronize copies the device state back
+// for host changes and readBack for host reads
+// Kernels share the host engines' steering math, all single precision so devices without fp64 can run them
+// A step's kernels are submitted without waiting, so with overlap set update returns while the device steps and the host
+// draws the previous step, which the kernels only read, until the next update waits for the step to finish
 class GPUFlock : public Flock { 
 private:
-    sycl::queue q;
+    // Kernels of a step are submitted back to back, the in order queue runs each after the previous one
+    // Snapshots are copied through a second queue on the same context, so the copies do not wait behind a step in flight
+    sycl::queue q = sycl::queue(sycl::property_list{ sycl::property::queue::in_order(), sycl::property::queue::enable_profiling() });
+    sycl::queue copies = sycl::queue(this->q.get_context(), this->q.get_device(), sycl::property_list{ sycl::property::queue::in_order() });
+
+    // Current and next step state, swapped on the device like state and next on the host
+    DeviceState deviceState;
+    DeviceState deviceNext;
+
+    // Visible lists in CSR form, boid i's visible ids are visibleIds[visibleOffsets[i]] to visibleIds[visibleOffsets[i + 1] - 1],
+    // so memory grows with the number of visible pairs instead of size^2
+    int* visibleCounts = nullptr;
+    int* visibleOffsets = nullptr;
+    int* visibleIds = nullptr;
+
+    // Scan block totals for the offsets
+    int* scanSums = nullptr;
+
+    // Pair total of the last step's lists, copied to host memory so it can be checked without another transfer
+    int* pairTotal = nullptr;
+
+    // Grid the visible lists are searched from
+    DeviceGrid deviceGrid;
+
+    // Leadership tables, a union-find forest over boids when electing per cluster, groups with a leader and the best claim
+    // per group packed like Leadership's claims
+    int* parent = nullptr;
+    int* led = nullptr;
+    unsigned long long* claims = nullptr;
+
+    // Boids and visible ids the buffers can hold
+    int deviceCapacity = 0;
+    std::size_t visibleCapacity = 0;
+
+    // Whether the device holds the current state, host state is then stale
+    bool resident = false;
+
+    // Step in flight, the events bracketing its kernels, its deltaTime should it need re-running, and when it was submitted
+    bool inFlight = false;
+    sycl::event stepBegin;
+    sycl::event stepEnd;
+    double pendingDelta = 0;
+    std::chrono::steady_clock::time_point submitted;
+
+    OverlapStats overlapStats;
+
+    void reserveDevice(int capacity);
+    void reserveVisible(std::size_t pairs);
+    void releaseDevice();
+
+    // Upload host state, growing device buffers to fit the flock
+    void upload();
+
+    // Kernel phases of a step, queued without waiting
+    void buildLists();
+    void prepareLeadership();
+    void stepBoids(double deltaTime);
+    void resolveLeadership();
+
+    // Queue every phase of a step and publish its state, finish then waits for it
+    // Lists that overflow the id buffer skip the rest of the step, finish then grows the buffer and runs the step again
+    void submitStep(double deltaTime);
+
+    // Add a finished step's host and device time, waiting from waitStart to waitEnd
+    void record(std::chrono::steady_clock::time_point waitStart, std::chrono::steady_clock::time_point waitEnd);
 
 public:
+    // Return from update while the step runs, snapshots and draws then show the step before it
+    bool overlap = false;
+
     template<typename F>
-    GPUFlock(F dna, float sWeight, float cWeight, float aWeight, std::mt19937 gen, std::shared_ptr<sf::RenderWindow> window) :
-        Flock(dna, sWeight, cWeight, aWeight, gen, window) {}
+    GPUFlock(F dna, int size, float sWeight, float cWeight, float aWeight, std::mt19937 gen, sf::Vector2u dimensions, std::shared_ptr<sf::RenderWindow> window = nullptr, int capacity = 0) :
+        Flock(dna, size, sWeight, cWeight, aWeight, gen, dimensions, window, capacity) {}
 
-    void flattenBoids(FlatBoid* output) {
-        for (int i = 0; i < this->size; i++) {
-            output[i] = this->boids[i].flatten();
-        }
+    ~GPUFlock() {
+        this->q.wait();
+        this->releaseDevice();
     }
 
+    // Buffers belong to the queue's context, so state is brought back to the host and buffers are freed before switching devices
     void setDevice(sycl::device d) {
-        this->q = sycl::queue(d);
+        this->synchronize();
+        this->releaseDevice();
+        this->q = sycl::queue(d, sycl::property_list{ sycl::property::queue::in_order(), sycl::property::queue::enable_profiling() });
+        this->copies = sycl::queue(this->q.get_context(), d, sycl::property_list{ sycl::property::queue::in_order() });
+    }
+
+    // Host and device time of the steps finished since the last reset
+    const OverlapStats& overlapTimes() const {
+        return this->overlapStats;
+    }
+
+    void resetOverlapTimes() {
+        this->overlapStats = OverlapStats();
     }
 
+    // Wait for the step in flight to finish, without reading anything back
+    void finish();
+
+    // Finish the step in flight and copy the resident state back into host state, which is uploaded again on the next update
+    void synchronize();
+
+    // Copy the resident state into host state for reading, the device copy stays resident and is stepped on from
+    std::uint64_t readBack(bool wait = true);
+
+    // Snapshots read back only what the renderer draws, from the state before the step in flight
+    void snapshot(Snapshot& frame);
+
     void update(double deltaTime);
-};
\ No newline at end of file
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "boid.h"
+#include "steering.h"
+
+#include <cstdint>
+#include <new>
+
+// Allocator returning cache line aligned storage, so hot arrays can be read with aligned vector loads
+template<typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        ::operator delete(p, n * sizeof(T), std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure of arrays holding the per-boid simulation state, indexed by boid id
+// Neighbour, steering and escape loops only stream the arrays they read instead of whole boids
+struct FlockState {
+    // Position
+    AlignedVector<float> x;
+    AlignedVector<float> y;
+
+    // Velocity
+    AlignedVector<float> vx;
+    AlignedVector<float> vy;
+
+    // Visibility radius is radius * visibility
+    AlignedVector<float> radius;
+    AlignedVector<float> visibility;
+
+    // Leadership
+    AlignedVector<std::uint8_t> leader;
+    AlignedVector<float> eccentricity;
+
+    // Speed limits, topSpeed follows the escape acceleration curve while leading
+    AlignedVector<float> topSpeed;
+    AlignedVector<float> defaultTopSpeed;
+
+    // Step a leader was promoted at
+    AlignedVector<std::uint64_t> leaderSince;
+
+    void resize(int count) {
+        this->x.resize(count);
+        this->y.resize(count);
+        this->vx.resize(count);
+        this->vy.resize(count);
+        this->radius.resize(count);
+        this->visibility.resize(count);
+        this->leader.resize(count);
+        this->eccentricity.resize(count);
+        this->topSpeed.resize(count);
+        this->defaultTopSpeed.resize(count);
+        this->leaderSince.resize(count);
+    }
+
+    // Unpack a boid's initial state into slot i
+    void set(int i, const Boid& boid) {
+        this->x[i] = boid.position.x;
+        this->y[i] = boid.position.y;
+        this->vx[i] = boid.velocity.x;
+        this->vy[i] = boid.velocity.y;
+        this->radius[i] = boid.radius;
+        this->visibility[i] = boid.visibility;
+        this->leader[i] = false;
+        this->eccentricity[i] = 0.f;
+        this->leaderSince[i] = 0;
+        this->topSpeed[i] = boid.topSpeed;
+        this->defaultTopSpeed[i] = boid.topSpeed;
+    }
+
+    // Copy slot j of another state (or this one) into slot i
+    void copy(int i, const FlockState& from, int j) {
+        this->x[i] = from.x[j];
+        this->y[i] = from.y[j];
+        this->vx[i] = from.vx[j];
+        this->vy[i] = from.vy[j];
+        this->radius[i] = from.radius[j];
+        this->visibility[i] = from.visibility[j];
+        this->leader[i] = from.leader[j];
+        this->eccentricity[i] = from.eccentricity[j];
+        this->topSpeed[i] = from.topSpeed[j];
+        this->defaultTopSpeed[i] = from.defaultTopSpeed[j];
+        this->leaderSince[i] = from.leaderSince[j];
+    }
+
+    sf::Vector2f position(int i) const {
+        return sf::Vector2f(this->x[i], this->y[i]);
+    }
+
+    sf::Vector2f velocity(int i) const {
+        return sf::Vector2f(this->vx[i], this->vy[i]);
+    }
+
+    // Arrays read by steering
+    StateView view() const {
+        return StateView{ this->x.data(), this->y.data(), this->vx.data(), this->vy.data(), this->leader.data() };
+    }
+};
+
+// Render-only data, kept out of FlockState so simulation loops never pull it through cache
+struct BoidRender {
+    // Last defined heading in degrees, kept while a boid is stopped since a zero velocity has no heading
+    float heading = 0.f;
+};
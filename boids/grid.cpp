@@ -0,0 +1,44 @@
+#include "grid.h"
+
+void SpatialGrid::rebuild(const FlockState& state, int count, const sf::Vector2u& dimensions) {
+    // Resize grid and counting sort boids into contiguous cell ranges
+
+    // Cell size follows the largest visibility radius a boid can have
+    float maxRadius = 1.f;
+
+    for (int i = 0; i < count; i++) {
+        maxRadius = std::max(maxRadius, GridShape::reach(state.radius[i], state.visibility[i], state.leader[i]));
+    }
+
+    this->shape = GridShape::fit(maxRadius, dimensions);
+
+    int cells = this->shape.cells();
+
+    this->cellOf.resize(count);
+    this->sorted.resize(count);
+    this->sortedX.resize(count);
+    this->sortedY.resize(count);
+    this->cellStart.assign(cells + 1, 0);
+
+    // Count boids per cell (offset by one so the prefix sum below produces start indices)
+    for (int i = 0; i < count; i++) {
+        this->cellOf[i] = this->shape.cellIndex(state.x[i], state.y[i]);
+        this->cellStart[this->cellOf[i] + 1]++;
+    }
+
+    // Prefix sum counts into cell start indices
+    for (int c = 0; c < cells; c++) {
+        this->cellStart[c + 1] += this->cellStart[c];
+    }
+
+    // Scatter boids and their positions into their cell ranges, using a copy of the start indices as write cursors
+    this->cursor.assign(this->cellStart.begin(), this->cellStart.end() - 1);
+
+    for (int i = 0; i < count; i++) {
+        int k = this->cursor[this->cellOf[i]]++;
+
+        this->sorted[k] = i;
+        this->sortedX[k] = state.x[i];
+        this->sortedY[k] = state.y[i];
+    }
+}
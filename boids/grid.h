@@ -0,0 +1,118 @@
+#pragma once
+
+#include "flockstate.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Cell layout of a uniform grid over the toroidal world, shared by SpatialGrid and GPUFlock's device grid
+// Header only and free of library calls beyond math so it can be used in device code
+struct GridShape {
+    int columns = 1;
+    int rows = 1;
+    float cellWidth = 1.f;
+    float cellHeight = 1.f;
+
+    // Largest visibility radius a boid can reach, including the 1.5x leader boost,
+    // so the grid does not change shape whenever a leader escapes or is reset
+    static float reach(float radius, float visibility, bool leader) {
+        float baseVisibility = leader ? visibility / 1.5f : visibility;
+        return radius * baseVisibility * 1.5f;
+    }
+
+    // Fit as many whole cells of at least maxRadius as possible into the world
+    static GridShape fit(float maxRadius, const sf::Vector2u& dimensions) {
+        GridShape shape;
+        shape.columns = std::max(1, static_cast<int>(dimensions.x / maxRadius));
+        shape.rows = std::max(1, static_cast<int>(dimensions.y / maxRadius));
+        shape.cellWidth = static_cast<float>(dimensions.x) / shape.columns;
+        shape.cellHeight = static_cast<float>(dimensions.y) / shape.rows;
+
+        return shape;
+    }
+
+    int cells() const {
+        return this->columns * this->rows;
+    }
+
+    // Get cell containing (x, y), wrapping positions that have stepped just outside the world
+    int cellIndex(float x, float y) const {
+        int column = static_cast<int>(std::floor(x / this->cellWidth)) % this->columns;
+        int row = static_cast<int>(std::floor(y / this->cellHeight)) % this->rows;
+
+        if (column < 0) column += this->columns;
+        if (row < 0) row += this->rows;
+
+        return row * this->columns + column;
+    }
+
+    // Call callback(cell) for each of the 3x3 cells around the cell containing (x, y), row by row
+    // With fewer than 3 cells in a dimension -1 and 1 would wrap onto the same cell, so neighbours are deduplicated
+    template<typename F>
+    void forEachNeighbour(float x, float y, F callback) const {
+        int cell = this->cellIndex(x, y);
+        int column = cell % this->columns;
+        int row = cell / this->columns;
+
+        for (int rowOffset = this->rows >= 3 ? -1 : 0; rowOffset <= (this->rows >= 2 ? 1 : 0); rowOffset++) {
+            // Wrap rows around the world edges
+            int neighbourRow = (row + rowOffset + this->rows) % this->rows;
+
+            for (int columnOffset = this->columns >= 3 ? -1 : 0; columnOffset <= (this->columns >= 2 ? 1 : 0); columnOffset++) {
+                // Wrap columns around the world edges
+                int neighbourColumn = (column + columnOffset + this->columns) % this->columns;
+
+                callback(neighbourRow * this->columns + neighbourColumn);
+            }
+        }
+    }
+};
+
+// Uniform grid over the toroidal world for neighbour search
+// Cells are at least as large as the largest visibility radius, so every visible boid lies in the 3x3 cells around the looking boid
+// Rebuilt every step with a counting sort, leaving each cell's boids contiguous in `sorted`
+class SpatialGrid {
+private:
+    // Grid dimensions
+    GridShape shape;
+
+    // Cell of each boid, indexed by boid id
+    std::vector<int> cellOf;
+
+    // Boids in cell c are sorted[cellStart[c]] to sorted[cellStart[c + 1] - 1]
+    std::vector<int> cellStart;
+    std::vector<int> sorted;
+
+    // Positions in sorted order, so each cell's coordinates are contiguous for vector loads
+    AlignedVector<float> sortedX;
+    AlignedVector<float> sortedY;
+
+    // Per-cell write cursors for the counting sort scatter, kept to avoid reallocating every step
+    std::vector<int> cursor;
+
+public:
+    // Resize grid to the world and current visibility radii, then bucket the first count boids into cells
+    void rebuild(const FlockState& state, int count, const sf::Vector2u& dimensions);
+
+    // Sorted boid ids and positions, ranges passed to forEachCell index into these
+    const int* ids() const {
+        return this->sorted.data();
+    }
+
+    const float* xs() const {
+        return this->sortedX.data();
+    }
+
+    const float* ys() const {
+        return this->sortedY.data();
+    }
+
+    // Call callback(begin, end) with the sorted range of every cell in the 3x3 cells around position (including the boid at position itself)
+    template<typename F>
+    void forEachCell(const sf::Vector2f& position, F callback) const {
+        this->shape.forEachNeighbour(position.x, position.y, [&](int neighbour) {
+            callback(this->cellStart[neighbour], this->cellStart[neighbour + 1]);
+        });
+    }
+};
@@ -0,0 +1,182 @@
+#include "boid.h"
+#include "flocks.h"
+#include "checkpoint.h"
+#include "trajectory.h"
+#include "runlog.h"
+
+#include <string>
+
+// Headless entry point, steps a flock without creating a render window so only simulation time is measured
+// Usage: boids-headless [mode SEQ/CPU/GPU/CHUNKED 0/1/2/3] [steps] [world width] [world height] [threads, 0 for one per hardware thread] [boids] [leader per cluster 0/1]
+//        [resume checkpoint, - for none] [save checkpoint, - for none] [record trajectory, - for none]
+//        [record run log]
+int main(int argc, char* argv[]) {
+    // Read configuration from command line, falling back to the windowed defaults
+    int mode = argc > 1 ? std::stoi(argv[1]) : 0;
+    int steps = argc > 2 ? std::stoi(argv[2]) : 1000;
+    sf::Vector2u dimensions(argc > 3 ? std::stoul(argv[3]) : 1920, argc > 4 ? std::stoul(argv[4]) : 1080);
+    unsigned int threads = argc > 5 ? std::stoul(argv[5]) : 0;
+    int count = argc > 6 ? std::stoi(argv[6]) : 500;
+    bool leaderPerCluster = argc > 7 && std::stoi(argv[7]) != 0;
+    std::string resume = argc > 8 && std::string(argv[8]) != "-" ? argv[8] : "";
+    std::string save = argc > 9 && std::string(argv[9]) != "-" ? argv[9] : "";
+    std::string record = argc > 10 && std::string(argv[10]) != "-" ? argv[10] : "";
+    std::string runLog = argc > 11 ? argv[11] : "";
+
+    // A resumed run takes its world from the checkpoint, CPUFlock chunks are laid out for the world at construction
+    // No boids are generated, the checkpoint's replace them
+    if (!resume.empty()) {
+        std::optional<checkpoint::Header> header = checkpoint::inspect(resume);
+
+        if (!header) {
+            std::cerr << "Invalid or unreadable checkpoint: " << resume << "\n";
+            return 1;
+        }
+
+        dimensions = sf::Vector2u(header->width, header->height);
+        count = 0;
+    }
+
+    // Seed and initialize random number generator
+    std::random_device rd;
+    std::mt19937 gen(rd());
+
+    // Initialize random distributions
+    std::uniform_real_distribution<float> rand_x(0, dimensions.x);
+    std::uniform_real_distribution<float> rand_y(0, dimensions.y);
+    std::uniform_real_distribution<float> rand_v(-200, 200);
+
+    auto dna = [&rand_x, &rand_y, &rand_v, &gen](int) {
+        return Boid(rand_x(gen), rand_y(gen),
+        5.f, // radius
+        200.f, // top speed
+        sf::Vector2f(rand_v(gen), rand_v(gen)), // initial velocity
+        15.f); // visibility
+    };
+
+    // Initialize selected flock without a window
+    std::unique_ptr<Flock> flock;
+
+    switch (mode) {
+    case 0:
+        flock = std::make_unique<Flock>(dna, count, 2.f, 0.25f, 0.25f, gen, dimensions);
+        break;
+    case 1:
+        flock = std::make_unique<NaiveCPUFlock>(dna, count, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, threads);
+        break;
+#ifdef BOIDS_SYCL
+    case 2: {
+        std::unique_ptr<GPUFlock> gpu = std::make_unique<GPUFlock>(dna, count, 2.f, 0.25f, 0.25f, gen, dimensions);
+        gpu->setDevice(sycl::device(sycl::default_selector_v));
+        flock = std::move(gpu);
+        break;
+    }
+#endif
+    case 3:
+        flock = std::make_unique<CPUFlock>(dna, count, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, 4);
+        break;
+    default:
+        std::cerr << "Invalid or unavailable execution mode: " << mode << "\n";
+        return 1;
+    }
+
+    flock->setPerCluster(leaderPerCluster);
+
+    // Checkpoints carry their own leadership setting
+    if (!resume.empty() && !checkpoint::load(*flock, resume)) {
+        std::cerr << "Could not load checkpoint: " << resume << "\n";
+        return 1;
+    }
+
+    // Log the run for boids-replay, each update's state hash is part of the timed steps
+    std::unique_ptr<RunRecorder> runRecorder;
+
+    if (!runLog.empty()) {
+        runRecorder = std::make_unique<RunRecorder>(runLog, *flock);
+
+        if (!runRecorder->good()) {
+            std::cerr << "Could not write run log: " << runLog << "\n";
+            return 1;
+        }
+    }
+
+    // Step through the run recorder when logging
+    auto update = [&](double deltaTime) {
+        if (runRecorder) {
+            runRecorder->update(*flock, deltaTime);
+        }
+        else {
+            flock->update(deltaTime);
+        }
+    };
+
+    // First frame has no deltaTime, matching the windowed loop
+    update(0);
+
+    // Work stealing counters only cover timed steps
+    if (NaiveCPUFlock* cpu = dynamic_cast<NaiveCPUFlock*>(flock.get())) {
+        cpu->workers().resetStats();
+    }
+
+    // Trajectories are written on the recorder's own thread, recording only copies each step's arrays
+    std::unique_ptr<TrajectoryRecorder> recorder;
+
+    if (!record.empty()) {
+        recorder = std::make_unique<TrajectoryRecorder>(record);
+    }
+
+    // Step flock at its fixed timestep and time the whole run
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < steps; i++) {
+        update(flock->timestep);
+
+        if (recorder) {
+            recorder->record(*flock);
+        }
+    }
+
+    std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(stop - start).count();
+
+    std::cout << "Mode: " << mode << ", Boids: " << flock->size << ", Steps: " << steps <<
+        ", Elapsed: " << elapsed << "s, Steps/s: " << steps / elapsed << "\n";
+
+    // Writing out the frames still queued is not part of the timed run
+    if (recorder) {
+        ChannelStats queue = recorder->queueStats();
+
+        if (!recorder->close()) {
+            std::cerr << "Could not write trajectory: " << record << "\n";
+            return 1;
+        }
+
+        RecorderStats recorded = recorder->stats();
+
+        std::cout << "Recorded " << recorded.frames << " frames in " << recorded.chunks << " chunks, " <<
+            recorded.storedBytes << " bytes (" << static_cast<double>(recorded.rawBytes) / std::max<std::uint64_t>(recorded.storedBytes, 1) <<
+            "x smaller than raw), Writer stalls: " << queue.writeStalls << "\n";
+    }
+
+    // Checkpoint the final step, so a later run can continue from it
+    if (!save.empty()) {
+        if (!checkpoint::save(*flock, save)) {
+            std::cerr << "Could not write checkpoint: " << save << "\n";
+            return 1;
+        }
+
+        std::cout << "Step " << flock->step << " checkpointed to " << save << "\n";
+    }
+
+    // Work stealing balance, idle is time spent waiting for other workers at the end of a phase
+    if (NaiveCPUFlock* cpu = dynamic_cast<NaiveCPUFlock*>(flock.get())) {
+        for (int w = 0; w < cpu->workers().size(); w++) {
+            const WorkerStats& s = cpu->workers().workerStats(w);
+
+            std::cout << "Worker " << w << ": Blocks: " << s.blocks << ", Steals: " << s.steals <<
+                ", Idle: " << s.idle * 1000 / steps << "ms/step\n";
+        }
+    }
+
+    return 0;
+}
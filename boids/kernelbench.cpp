@@ -0,0 +1,97 @@
+#include "sfvec.h"
+#include "simd.h"
+
+#include <string>
+
+// Visibility kernel microbenchmark
+// Tests `queries` boids against `candidates` candidates with every kernel the CPU supports, checks every kernel
+// returns the same visibility sets as the scalar kernel and reports candidate tests per second
+// Usage: boids-kernel-bench [candidates] [queries] [visibility radius]
+int main(int argc, char* argv[]) {
+    int candidates = argc > 1 ? std::stoi(argv[1]) : 4096;
+    int queries = argc > 2 ? std::stoi(argv[2]) : 4096;
+    float visibilityRadius = argc > 3 ? std::stof(argv[3]) : 75.f;
+
+    const sf::Vector2u dimensions(1920, 1080);
+    const float radiusSquared = visibilityRadius * visibilityRadius;
+
+    // Random candidate and query positions
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> rand_x(0, dimensions.x);
+    std::uniform_real_distribution<float> rand_y(0, dimensions.y);
+
+    std::vector<float> xs(candidates);
+    std::vector<float> ys(candidates);
+    std::vector<sf::Vector2f> queryPositions(queries);
+
+    for (int k = 0; k < candidates; k++) {
+        xs[k] = rand_x(gen);
+        ys[k] = rand_y(gen);
+    }
+
+    for (sf::Vector2f& q : queryPositions) {
+        q = sf::Vector2f(rand_x(gen), rand_y(gen));
+    }
+
+    std::vector<int> out(candidates);
+    std::vector<int> expected;
+    std::vector<int> offsets;
+
+    // Reference, the per-pair sfvec path Flock::look used before the kernels
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long long visibleCount = 0;
+
+    for (const sf::Vector2f& q : queryPositions) {
+        for (int k = 0; k < candidates; k++) {
+            visibleCount += sfvec::getToroidalDistance(q, sf::Vector2f(xs[k], ys[k]), dimensions) < visibilityRadius;
+        }
+    }
+
+    double referenceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double tests = static_cast<double>(candidates) * queries;
+
+    std::cout << "sfvec reference: " << tests / referenceTime / 1e6 << " M tests/s (" << visibleCount << " visible)\n";
+
+    // Scalar kernel results, every kernel must reproduce them exactly
+    for (const sf::Vector2f& q : queryPositions) {
+        int found = simd::visibleScalar(q.x, q.y, radiusSquared, xs.data(), ys.data(), candidates, (float)dimensions.x, (float)dimensions.y, out.data());
+
+        offsets.push_back(static_cast<int>(expected.size()));
+        expected.insert(expected.end(), out.begin(), out.begin() + found);
+    }
+
+    offsets.push_back(static_cast<int>(expected.size()));
+
+    bool allMatch = true;
+    simd::Level best = simd::detect();
+
+    for (int level = static_cast<int>(simd::Level::Scalar); level <= static_cast<int>(best); level++) {
+        simd::VisibilityKernel kernel = simd::kernel(static_cast<simd::Level>(level));
+
+        // Check visibility sets against scalar
+        bool match = true;
+
+        for (int q = 0; q < queries && match; q++) {
+            int found = kernel(queryPositions[q].x, queryPositions[q].y, radiusSquared, xs.data(), ys.data(), candidates, (float)dimensions.x, (float)dimensions.y, out.data());
+
+            match = found == offsets[q + 1] - offsets[q] && std::equal(out.begin(), out.begin() + found, expected.begin() + offsets[q]);
+        }
+
+        // Time kernel
+        start = std::chrono::steady_clock::now();
+        visibleCount = 0;
+
+        for (const sf::Vector2f& q : queryPositions) {
+            visibleCount += kernel(q.x, q.y, radiusSquared, xs.data(), ys.data(), candidates, (float)dimensions.x, (float)dimensions.y, out.data());
+        }
+
+        double kernelTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << simd::name(static_cast<simd::Level>(level)) << ": " << tests / kernelTime / 1e6 << " M tests/s (" << visibleCount << " visible), " <<
+            referenceTime / kernelTime << "x reference, " << (match ? "matches scalar" : "MISMATCH") << "\n";
+
+        allMatch = allMatch && match;
+    }
+
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#include "leadership.h"
+
+#include <cstring>
+
+void Leadership::resize(int capacity) {
+    // Atomics can not be copied, so tables are rebuilt instead of grown in place
+
+    if (static_cast<int>(this->claims.size()) >= capacity) {
+        return;
+    }
+
+    this->parent = std::vector<std::atomic<int>>(capacity);
+    this->claims = std::vector<std::atomic<unsigned long long>>(capacity);
+    this->led.resize(capacity);
+    this->claimed.resize(capacity);
+}
+
+void Leadership::begin(int count) {
+    // Reset the forest, claims are already cleared by the previous resolve
+
+    if (this->perCluster) {
+        for (int i = 0; i < count; i++) {
+            this->parent[i].store(i, std::memory_order_relaxed);
+        }
+    }
+}
+
+int Leadership::find(int i) const {
+    // Follow parents to the root, the forest is only read once every link of the step has been made
+
+    int p;
+
+    while ((p = this->parent[i].load(std::memory_order_acquire)) != i) {
+        i = p;
+    }
+
+    return i;
+}
+
+int Leadership::findHalving(int i) {
+    // Follow parents to the root, pointing every other node at its grandparent on the way (path halving)
+    // Only roots are re-parented by link's CAS, a non-root's parent only ever moves further up its tree,
+    // so a plain store of an ancestor is safe even if another thread shortened the same path first
+
+    for (;;) {
+        int p = this->parent[i].load(std::memory_order_acquire);
+
+        if (p == i) {
+            return i;
+        }
+
+        int g = this->parent[p].load(std::memory_order_acquire);
+
+        if (p != g) {
+            this->parent[i].store(g, std::memory_order_release);
+        }
+
+        i = g;
+    }
+}
+
+int Leadership::root(int i) {
+    // Root of boid i's cluster so far
+
+    return this->findHalving(i);
+}
+
+int Leadership::link(int root, int j) {
+    // Hang the higher root under the lower one, retrying when another thread re-rooted either first
+
+    for (;;) {
+        root = this->findHalving(root);
+        j = this->findHalving(j);
+
+        if (root == j) {
+            return root;
+        }
+
+        if (root > j) {
+            std::swap(root, j);
+        }
+
+        int expected = j;
+
+        if (this->parent[j].compare_exchange_weak(expected, root, std::memory_order_acq_rel)) {
+            return root;
+        }
+    }
+}
+
+void Leadership::prepare(const FlockState& state, int count) {
+    // Flag the groups of current leaders
+
+    int groups = this->perCluster ? count : 1;
+
+    std::memset(this->led.data(), 0, groups);
+
+    for (int i = 0; i < count; i++) {
+        if (state.leader[i]) {
+            this->led[this->group(i)] = true;
+        }
+    }
+}
+
+void Leadership::claim(int i, float margin) {
+    // Keep the largest packed claim
+
+    unsigned long long key = steering::claimKey(i, margin);
+
+    int root = this->group(i);
+    std::atomic<unsigned long long>& best = this->claims[root];
+    unsigned long long current = best.load(std::memory_order_relaxed);
+
+    // The first claim of a group records the group for resolve
+    if (current == 0 && best.compare_exchange_strong(current, key, std::memory_order_relaxed)) {
+        this->claimed[this->claimedCount.fetch_add(1, std::memory_order_relaxed)] = root;
+        return;
+    }
+
+    while (key > current && !best.compare_exchange_weak(current, key, std::memory_order_relaxed)) {
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "flockstate.h"
+
+#include <atomic>
+#include <vector>
+
+// Per-flock leader election
+// During a step boids never become leader directly, escaping boids claim leadership of their group with an atomic
+// compare-and-swap that keeps the most eager claim (largest escape margin, lowest id on ties), and the winners are
+// promoted once the step's state is published
+// Whether a group already has a leader is taken from the published state, leaders release themselves when their timer
+// runs out, so the whole escape phase runs in parallel without locks and its outcome does not depend on thread order
+// Groups are the whole flock, or with perCluster the connected components of the visibility graph, built with a
+// lock-free union-find while boids look
+class Leadership {
+private:
+    // Union-find forest over boids, roots are the lowest id in their component so components are found deterministically
+    std::vector<std::atomic<int>> parent;
+
+    // Best claim per group root, packed as (escape margin bits << 32 | ~id), 0 when unclaimed
+    std::vector<std::atomic<unsigned long long>> claims;
+
+    // Groups that already have a leader in the published state, indexed by root
+    std::vector<std::uint8_t> led;
+
+    // Roots claimed this step, so promotion does not scan every group
+    std::vector<int> claimed;
+    std::atomic<int> claimedCount = 0;
+
+    bool perCluster = false;
+
+    int find(int i) const;
+    int findHalving(int i);
+
+public:
+    // Elect one leader per cluster of mutually visible boids instead of one for the whole flock
+    void setPerCluster(bool perCluster) {
+        this->perCluster = perCluster;
+    }
+
+    bool clustered() const {
+        return this->perCluster;
+    }
+
+    // Size tables for up to capacity boids
+    void resize(int capacity);
+
+    // Start a step, every boid is its own cluster until linked
+    void begin(int count);
+
+    // Root of boid i's cluster so far, to pass to link while walking its visible boids
+    int root(int i);
+
+    // Join boid j's cluster with the cluster rooted at (or containing) root and return the joined cluster's root
+    // Safe to call from any thread while boids look, keeping the returned root skips re-finding it for every visible boid
+    int link(int root, int j);
+
+    // Mark groups holding a leader in the published state, once every link of the step has been made
+    void prepare(const FlockState& state, int count);
+
+    // Group a boid claims leadership of
+    int group(int i) const {
+        return this->perCluster ? this->find(i) : 0;
+    }
+
+    // Whether boid i may claim leadership this step
+    bool available(int i) const {
+        return !this->led[this->group(i)];
+    }
+
+    // Claim leadership of boid i's group, margin is how far its escape chance exceeded the threshold (> 0)
+    void claim(int i, float margin);
+
+    // Call promote(id) for the winning claim of every claimed group, then clear claims for the next step
+    template<typename F>
+    void resolve(F promote) {
+        int count = this->claimedCount.load(std::memory_order_relaxed);
+
+        for (int k = 0; k < count; k++) {
+            int root = this->claimed[k];
+            unsigned long long best = this->claims[root].exchange(0, std::memory_order_relaxed);
+
+            promote(steering::claimant(best));
+        }
+
+        this->claimedCount.store(0, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,79 @@
+#include "neighbours.h"
+
+#include <algorithm>
+
+void NeighbourLists::resize(int count, int segmentCount) {
+    // Size offsets for count boids and create segmentCount empty segments, reusing capacity when the flock shrinks or regrows
+    // An empty flock split into blocks has no segments, so no stale segment is left to be laid out past its offsets
+
+    this->offsets.assign(count + 1, 0);
+    this->segments.resize(segmentCount);
+}
+
+void NeighbourLists::beginSegment(int segment, int lower, int upper) {
+    // Reset segment for this step's range, keeping its buffer's capacity
+
+    Segment& s = this->segments[segment];
+
+    s.lower = lower;
+    s.upper = upper;
+    s.ids.clear();
+}
+
+void NeighbourLists::prepareJoin() {
+    // Lay segments out back to back in the index buffer
+
+    int base = 0;
+
+    for (Segment& s : this->segments) {
+        s.base = base;
+
+        // Boundary offsets are shared between neighbouring segments, so they are only written here
+        this->offsets[s.lower] = base;
+        base += static_cast<int>(s.ids.size());
+        this->offsets[s.upper] = base;
+    }
+
+    this->ids.resize(base);
+}
+
+void NeighbourLists::joinSegment(int segment) {
+    // Copy segment ids to the index buffer and offset its inner boundaries by the segment base
+
+    Segment& s = this->segments[segment];
+
+    std::copy(s.ids.begin(), s.ids.end(), this->ids.begin() + s.base);
+
+    for (int i = s.lower + 1; i < s.upper; i++) {
+        this->offsets[i] += s.base;
+    }
+}
+
+void NeighbourLists::join() {
+    // Join all segments, a single segment is already laid out and swaps buffers instead of copying
+
+    if (this->segments.size() == 1) {
+        Segment& s = this->segments[0];
+
+        this->offsets[s.lower] = 0;
+        this->offsets[s.upper] = static_cast<int>(s.ids.size());
+        std::swap(this->ids, s.ids);
+
+        return;
+    }
+
+    this->prepareJoin();
+
+    for (int segment = 0; segment < static_cast<int>(this->segments.size()); segment++) {
+        this->joinSegment(segment);
+    }
+}
+
+void NeighbourLists::assignRows(const int* offsets, const int* ids) {
+    // Copy offsets and the ids they cover, reusing both buffers' capacity
+
+    int count = static_cast<int>(this->offsets.size()) - 1;
+
+    std::copy(offsets, offsets + count + 1, this->offsets.begin());
+    this->ids.assign(ids, ids + offsets[count]);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Visible boid lists for one step in compressed sparse row form
+// Boid i's visible boids are ids[offsets[i]] to ids[offsets[i + 1] - 1], so list sizes are O(1) offset differences
+// Lists are filled into independent segments, each covering a contiguous range of boids, then joined into the shared index buffer
+// All buffers are reused across steps, so no allocation happens once they have grown to the flock's neighbour count
+class NeighbourLists {
+private:
+    struct Segment {
+        // Range of boids filled by this segment
+        int lower = 0;
+        int upper = 0;
+
+        // Start of this segment in the joined index buffer
+        int base = 0;
+
+        std::vector<int> ids;
+    };
+
+    std::vector<int> offsets;
+    std::vector<int> ids;
+
+    std::vector<Segment> segments;
+
+    // Per-boid write cursors for assign's counting sort scatter, kept to avoid reallocating every step
+    std::vector<int> cursor;
+
+public:
+    // Size lists for count boids filled in segmentCount segments, which together must cover every boid in order
+    void resize(int count, int segmentCount);
+
+    // Start filling a segment with boids lower to upper - 1, which must then be looked at in increasing order
+    void beginSegment(int segment, int lower, int upper);
+
+    // Add id to the list of the boid currently being filled in segment
+    void add(int segment, int id) {
+        this->segments[segment].ids.push_back(id);
+    }
+
+    // Close boid i's list, recording its end relative to the segment
+    void close(int segment, int i) {
+        this->offsets[i + 1] = static_cast<int>(this->segments[segment].ids.size());
+    }
+
+    // Place every filled segment in the index buffer and write segment boundary offsets
+    // Runs once per step on one thread, after every segment is filled and before any joinSegment
+    void prepareJoin();
+
+    // Copy a segment into its place in the index buffer and make its offsets global
+    // Each segment only writes offsets inside its own range, so segments can be joined concurrently
+    void joinSegment(int segment);
+
+    // Join all segments on the calling thread
+    void join();
+
+    // Build lists from unordered (looking, visible) pairs with a counting sort, for engines that find pairs out of order
+    template<typename F>
+    void assign(int pairCount, F pairAt) {
+        int count = static_cast<int>(this->offsets.size()) - 1;
+
+        // Count visible boids per looking boid (offset by one so the prefix sum below produces start indices)
+        std::fill(this->offsets.begin(), this->offsets.end(), 0);
+
+        for (int k = 0; k < pairCount; k++) {
+            std::pair<int, int> pair = pairAt(k);
+
+            if (pair.first != pair.second) {
+                this->offsets[pair.first + 1]++;
+            }
+        }
+
+        // Prefix sum counts into start indices
+        for (int i = 0; i < count; i++) {
+            this->offsets[i + 1] += this->offsets[i];
+        }
+
+        // Scatter visible ids into their lists, using a copy of the start indices as write cursors
+        this->cursor.assign(this->offsets.begin(), this->offsets.end() - 1);
+        this->ids.resize(this->offsets[count]);
+
+        for (int k = 0; k < pairCount; k++) {
+            std::pair<int, int> pair = pairAt(k);
+
+            if (pair.first != pair.second) {
+                this->ids[this->cursor[pair.first]++] = pair.second;
+            }
+        }
+    }
+
+    // Copy lists already in compressed sparse row form, offsets must hold count + 1 entries starting at 0 for the count set by resize
+    void assignRows(const int* offsets, const int* ids);
+
+    // Number of boids visible to boid i
+    int count(int i) const {
+        return this->offsets[i + 1] - this->offsets[i];
+    }
+
+    // Ids of boids visible to boid i
+    std::span<const int> of(int i) const {
+        return std::span<const int>(this->ids.data() + this->offsets[i], this->count(i));
+    }
+
+    // Total number of visible pairs
+    int total() const {
+        return this->offsets.back();
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+// Each call maps a (key, counter) pair straight to 4 random words, there is no engine state to share or advance,
+// so any thread or SYCL work item can draw the numbers for a given boid and step independently and reproducibly
+// Header only and free of library calls so it can be used in device code
+namespace philox {
+
+    struct Block {
+        std::uint32_t v[4];
+    };
+
+    // One Philox round, multiplying two words and mixing their high halves with the others and the key
+    inline Block round(const Block& c, std::uint32_t k0, std::uint32_t k1) {
+        const std::uint64_t m0 = 0xD2511F53ull;
+        const std::uint64_t m1 = 0xCD9E8D57ull;
+
+        std::uint64_t p0 = m0 * c.v[0];
+        std::uint64_t p1 = m1 * c.v[2];
+
+        return Block{ {
+            static_cast<std::uint32_t>(p1 >> 32) ^ c.v[1] ^ k0,
+            static_cast<std::uint32_t>(p1),
+            static_cast<std::uint32_t>(p0 >> 32) ^ c.v[3] ^ k1,
+            static_cast<std::uint32_t>(p0)
+        } };
+    }
+
+    // Random block for counter under a 64-bit key
+    inline Block generate(Block counter, std::uint64_t key) {
+        std::uint32_t k0 = static_cast<std::uint32_t>(key);
+        std::uint32_t k1 = static_cast<std::uint32_t>(key >> 32);
+
+        for (int r = 0; r < 10; r++) {
+            counter = round(counter, k0, k1);
+
+            // Weyl sequence key schedule
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+
+        return counter;
+    }
+
+    // Uniform float in [0, 1) from the top 24 bits of a word, every value is exactly representable
+    inline float uniform(std::uint32_t bits) {
+        return (bits >> 8) * (1.f / 16777216.f);
+    }
+
+    // Streams drawn from the same (seed, id, step), so different uses never share numbers
+    enum Stream : std::uint32_t {
+        Escape = 0
+    };
+
+    // Uniform float in [0, 1) for an entity id at a step, keyed by seed
+    inline float uniform(std::uint64_t seed, std::uint32_t id, std::uint64_t step, Stream stream) {
+        Block counter{ { id, static_cast<std::uint32_t>(step), static_cast<std::uint32_t>(step >> 32), stream } };
+
+        return uniform(generate(counter, seed).v[0]);
+    }
+}
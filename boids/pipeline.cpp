@@ -0,0 +1,73 @@
+#include "pipeline.h"
+
+SimulationPipeline::SimulationPipeline(Flock& flock, std::size_t depth) :
+    flock(flock), frames(make_channel<Snapshot>(depth)), spares(make_channel<Snapshot>()) {
+    // Stop the flock drawing in update, then start stepping it
+    this->deferred = this->flock.deferDraw;
+    this->flock.deferDraw = true;
+    this->worker = std::thread(&SimulationPipeline::run, this);
+}
+
+SimulationPipeline::~SimulationPipeline() {
+    this->stop();
+}
+
+void SimulationPipeline::run() {
+    // Step on a fixed timestep clock and publish a snapshot after every frame's worth of steps
+
+    profiler::nameThread("Simulation");
+
+    SimulationClock clock(this->flock.timestep);
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+    while (!this->stopping) {
+        // Spend the real time since the last frame in whole steps, waiting for the next step when ahead of real time
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        int steps = clock.advance(std::chrono::duration<double>(now - last).count());
+        last = now;
+
+        if (!steps) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(clock.untilNextStep()));
+            continue;
+        }
+
+        for (int s = 0; s < steps; s++) {
+            this->flock.update(clock.timestep());
+        }
+
+        // Refill a drawn snapshot if one has been returned, otherwise start a new one
+        Snapshot frame = this->spares.second.tryRead().value_or(Snapshot());
+        this->flock.snapshot(frame);
+
+        // Blocks while the render thread is depth snapshots behind, fails once closed
+        // Time spent stalled is spent in steps on the next frame, up to the clock's step limit
+        PROFILE_ZONE("queue");
+
+        if (!this->frames.first.write(std::move(frame))) {
+            break;
+        }
+    }
+}
+
+std::optional<Snapshot> SimulationPipeline::next() {
+    PROFILE_ZONE("queue");
+    return this->frames.second.read();
+}
+
+void SimulationPipeline::release(Snapshot frame) {
+    this->spares.first.write(std::move(frame));
+}
+
+void SimulationPipeline::stop() {
+    // Wake a stalled simulation thread and wait for its step to finish
+
+    if (!this->worker.joinable()) {
+        return;
+    }
+
+    this->stopping = true;
+    this->frames.first.close();
+    this->worker.join();
+
+    this->flock.deferDraw = this->deferred;
+}
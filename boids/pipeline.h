@@ -0,0 +1,54 @@
+#pragma once
+
+#include "flocks.h"
+#include "simclock.h"
+
+#include <atomic>
+#include <thread>
+#include <optional>
+
+// Steps a flock on its own thread ahead of the render thread, publishing an immutable snapshot after each frame's steps
+// The render thread draws step N while step N + 1 is simulated, so frame time approaches the slower of the two instead of their sum
+// Snapshots pass through a bounded channel, a full queue stalls the simulation and an empty one stalls rendering
+// Drawn snapshots are handed back through a second channel and refilled, so steady state stepping does not allocate
+class SimulationPipeline {
+private:
+    Flock& flock;
+
+    // Published snapshots (simulation to render) and drawn ones returned for reuse (render to simulation)
+    std::pair<Channel<Snapshot>, Channel<Snapshot>> frames;
+    std::pair<Channel<Snapshot>, Channel<Snapshot>> spares;
+
+    // Flock's own deferDraw setting, restored when stopped
+    bool deferred = false;
+
+    std::atomic<bool> stopping = false;
+    std::thread worker;
+
+    // Simulation thread loop
+    void run();
+
+public:
+    // Start stepping flock at its timestep, it must not be updated or drawn elsewhere until the pipeline is stopped
+    // depth is the number of published snapshots the simulation may run ahead of rendering
+    SimulationPipeline(Flock& flock, std::size_t depth = 2);
+
+    SimulationPipeline(const SimulationPipeline&) = delete;
+    SimulationPipeline& operator=(const SimulationPipeline&) = delete;
+
+    ~SimulationPipeline();
+
+    // Oldest published snapshot, blocking until one is available, empty once stopped
+    std::optional<Snapshot> next();
+
+    // Hand a drawn snapshot back for the simulation to refill
+    void release(Snapshot frame);
+
+    // Stop and join the simulation thread, restoring the flock's drawing
+    void stop();
+
+    // Queue depth and stalls, write stalls are steps that waited on rendering and read stalls frames that waited on simulation
+    ChannelStats stats() const {
+        return this->frames.second.stats();
+    }
+};
@@ -0,0 +1,211 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace profiler {
+    // Completed zone, times in nanoseconds since the profiler's epoch
+    struct Event {
+        const char* name;
+        long long start;
+        long long end;
+    };
+
+    // One thread's zones, the lock is only contended while a trace or summary is being written
+    struct Ring {
+        std::mutex lock;
+        std::vector<Event> events;
+
+        // Zones ever recorded, the newest is at (written - 1) % ringCapacity
+        std::size_t written = 0;
+
+        int id = 0;
+        std::string name;
+    };
+
+    // Every thread's ring and the frame marks
+    struct Registry {
+        std::mutex lock;
+        std::vector<std::shared_ptr<Ring>> rings;
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+        // Last two frame marks, -1 until set
+        long long previousFrame = -1;
+        long long lastFrame = -1;
+        unsigned long long frames = 0;
+    };
+
+    // Never destroyed, so threads still recording while the process exits do not touch a destroyed registry
+    static Registry& registry() {
+        static Registry* r = new Registry();
+        return *r;
+    }
+
+    // Create the registry at load time, so the epoch precedes every zone
+    static const Registry& loaded = registry();
+
+    static long long sinceEpoch(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t - registry().epoch).count();
+    }
+
+    // Calling thread's ring, created and registered on its first zone
+    static thread_local std::shared_ptr<Ring> local;
+    static thread_local std::string localName;
+
+    static Ring& ring() {
+        if (!local) {
+            local = std::make_shared<Ring>();
+            local->events.resize(ringCapacity);
+
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+
+            local->id = static_cast<int>(r.rings.size());
+            local->name = localName.empty() ? "Thread " + std::to_string(local->id) : localName;
+            r.rings.push_back(local);
+        }
+
+        return *local;
+    }
+
+    // Visit the zones held in a ring from oldest to newest, the ring's lock must be held
+    template<typename F>
+    static void forEach(const Ring& ring, F visit) {
+        std::size_t held = std::min(ring.written, ringCapacity);
+
+        for (std::size_t k = ring.written - held; k < ring.written; k++) {
+            visit(ring.events[k % ringCapacity]);
+        }
+    }
+
+    void nameThread(const std::string& name) {
+        // Kept for the ring created on the first zone, or applied now if it already exists
+        localName = name;
+
+        if (local) {
+            std::lock_guard<std::mutex> guard(local->lock);
+            local->name = name;
+        }
+    }
+
+    void record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+        Ring& r = ring();
+        std::lock_guard<std::mutex> guard(r.lock);
+
+        r.events[r.written % ringCapacity] = Event{ name, sinceEpoch(start), sinceEpoch(end) };
+        r.written++;
+    }
+
+    void frame() {
+        // Record the frame itself as a zone, then move the marks along
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        long long mark = sinceEpoch(now);
+        long long previous;
+
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+
+            previous = r.lastFrame;
+            r.previousFrame = r.lastFrame;
+            r.lastFrame = mark;
+            r.frames++;
+        }
+
+        if (enabled() && previous >= 0) {
+            record("frame", registry().epoch + std::chrono::nanoseconds(previous), now);
+        }
+    }
+
+    bool writeTrace(const std::string& path) {
+        // Complete ("X") events in microseconds, one track per thread named by a metadata event
+
+        std::ofstream out(path);
+
+        if (!out) {
+            return false;
+        }
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        bool first = true;
+
+        for (const std::shared_ptr<Ring>& ring : r.rings) {
+            std::lock_guard<std::mutex> ringGuard(ring->lock);
+
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << ring->id <<
+                ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+            first = false;
+
+            forEach(*ring, [&out, &ring](const Event& e) {
+                out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << ring->id <<
+                    ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+            });
+        }
+
+        out << "\n]}\n";
+
+        return static_cast<bool>(out);
+    }
+
+    void writeSummary(std::ostream& out) {
+        // Sum zone durations per thread over the zones started within the last complete frame
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+
+        if (!enabled()) {
+            out << "Profiling compiled out, build with BOIDS_PROFILE to record zones\n";
+            return;
+        }
+
+        if (r.previousFrame < 0) {
+            out << "No complete frame recorded\n";
+            return;
+        }
+
+        out << "Frame " << r.frames - 1 << ": " << (r.lastFrame - r.previousFrame) / 1e6 << "ms\n";
+
+        for (const std::shared_ptr<Ring>& ring : r.rings) {
+            std::lock_guard<std::mutex> ringGuard(ring->lock);
+
+            // Zone totals in order of first appearance
+            std::vector<std::pair<const char*, long long>> totals;
+
+            forEach(*ring, [&totals, &r](const Event& e) {
+                if (e.start < r.previousFrame || e.start >= r.lastFrame) {
+                    return;
+                }
+
+                for (std::pair<const char*, long long>& total : totals) {
+                    if (std::string(total.first) == e.name) {
+                        total.second += e.end - e.start;
+                        return;
+                    }
+                }
+
+                totals.emplace_back(e.name, e.end - e.start);
+            });
+
+            if (totals.empty()) {
+                continue;
+            }
+
+            out << "  " << ring->name << ":";
+
+            for (const std::pair<const char*, long long>& total : totals) {
+                out << " " << total.first << " " << total.second / 1e6 << "ms";
+            }
+
+            out << "\n";
+        }
+    }
+}
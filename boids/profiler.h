@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+// Hot path profiler, recording named zones into per-thread ring buffers
+// Zones are placed with PROFILE_ZONE, which compiles to nothing unless BOIDS_PROFILE is defined, so release builds pay nothing
+// Recorded zones can be written as a Chrome trace (chrome://tracing or ui.perfetto.dev) and summarised per frame
+namespace profiler {
+    // Zones kept per thread, the oldest are overwritten once a thread's ring is full
+    const std::size_t ringCapacity = 1 << 15;
+
+    // Whether PROFILE_ZONE records anything in this build
+    constexpr bool enabled() {
+#ifdef BOIDS_PROFILE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Name the calling thread in traces and summaries
+    void nameThread(const std::string& name);
+
+    // Record a completed zone on the calling thread, name must stay valid for the whole run (string literals)
+    void record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    // Mark the end of a frame on the calling thread, summaries cover the zones started between the last two marks
+    void frame();
+
+    // Write every zone still held in the rings as Chrome trace event JSON, returning false if the file can not be opened
+    bool writeTrace(const std::string& path);
+
+    // Write time spent in each zone per thread during the last complete frame
+    // Zones nest, so a zone's time includes the zones inside it
+    void writeSummary(std::ostream& out);
+
+    // Records the time between its construction and destruction as a zone
+    class Zone {
+    private:
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit Zone(const char* name) :
+            name(name), start(std::chrono::steady_clock::now()) {}
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+        ~Zone() {
+            record(this->name, this->start, std::chrono::steady_clock::now());
+        }
+    };
+}
+
+// Profile the rest of the enclosing scope as a zone called name
+#ifdef BOIDS_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
@@ -0,0 +1,77 @@
+#include "renderer.h"
+
+#define _USE_MATH_DEFINES
+
+#include <array>
+#include <math.h>
+
+// Unit circle directions of a visibility disc's rim, shared by every disc
+static const std::array<sf::Vector2f, FlockRenderer::discSegments + 1> discRim = [] {
+    std::array<sf::Vector2f, FlockRenderer::discSegments + 1> rim;
+
+    for (int k = 0; k <= FlockRenderer::discSegments; k++) {
+        float angle = k * 2 * M_PI / FlockRenderer::discSegments;
+        rim[k] = sf::Vector2f(cos(angle), sin(angle));
+    }
+
+    return rim;
+}();
+
+void FlockRenderer::prepare(int count) {
+    // Size vertex buffers to the snapshot's boids, each boid owns a fixed slice so slices can be written in any order
+    this->triangles.resize(count * 3);
+    this->visibilityDiscs.resize(this->showVisibility ? count * this->discSegments * 3 : 0);
+}
+
+void FlockRenderer::write(const Snapshot& frame, int i) {
+    // Write i-th boid's triangle and visibility disc into its slices at its position and heading
+
+    sf::Vector2f position(frame.x[i], frame.y[i]);
+
+    // Triangle matches a 3 point circle shape of the boid's radius rotated to its heading, corners starting at the top
+    float radius = frame.radius[i];
+    float rotation = frame.heading[i] * M_PI / 180 - M_PI / 2;
+
+    // Escaping boids are drawn red
+    sf::Color color = frame.leader[i] ? sf::Color::Red : sf::Color::White;
+
+    for (int k = 0; k < 3; k++) {
+        float angle = rotation + k * 2 * M_PI / 3;
+        this->triangles[i * 3 + k] = sf::Vertex(position + sf::Vector2f(cos(angle), sin(angle)) * radius, color);
+    }
+
+    if (!this->showVisibility) {
+        return;
+    }
+
+    // Visibility disc as a fan of triangles around the boid's position
+    float visibilityRadius = frame.visibilityRadius[i];
+    sf::Color discColor(0, 0, 150, 10);
+    std::size_t base = static_cast<std::size_t>(i) * this->discSegments * 3;
+
+    for (int k = 0; k < this->discSegments; k++) {
+        this->visibilityDiscs[base + k * 3] = sf::Vertex(position, discColor);
+        this->visibilityDiscs[base + k * 3 + 1] = sf::Vertex(position + discRim[k] * visibilityRadius, discColor);
+        this->visibilityDiscs[base + k * 3 + 2] = sf::Vertex(position + discRim[k + 1] * visibilityRadius, discColor);
+    }
+}
+
+void FlockRenderer::submit(sf::RenderWindow& window) {
+    // Queue discs under triangles, one draw call each
+    if (this->showVisibility) {
+        window.draw(this->visibilityDiscs);
+    }
+
+    window.draw(this->triangles);
+}
+
+void FlockRenderer::draw(const Snapshot& frame, sf::RenderWindow& window) {
+    // Write every boid's vertices on the calling thread, then submit them
+    this->prepare(frame.size);
+
+    for (int i = 0; i < frame.size; i++) {
+        this->write(frame, i);
+    }
+
+    this->submit(window);
+}
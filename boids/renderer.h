@@ -0,0 +1,35 @@
+#pragma once
+
+#include "snapshot.h"
+
+#include <SFML/Graphics.hpp>
+
+// Batched flock renderer, building every boid's triangle and visibility disc from a snapshot
+// All triangles and all discs are submitted with one draw call each
+// Boid i owns vertices 3i to 3i + 2 of triangles and its disc's discSegments triangles of visibilityDiscs,
+// so once the buffers are sized boids can be written concurrently
+class FlockRenderer {
+private:
+    sf::VertexArray triangles = sf::VertexArray(sf::Triangles);
+    sf::VertexArray visibilityDiscs = sf::VertexArray(sf::Triangles);
+
+public:
+    // Visibility disc overlay, toggled at runtime
+    bool showVisibility = true;
+
+    // Triangles per visibility disc
+    static const int discSegments = 16;
+
+    // Size vertex buffers for count boids, must run before write in every frame
+    void prepare(int count);
+
+    // Write boid i's vertices from a snapshot into its slices
+    void write(const Snapshot& frame, int index);
+
+    // Queue discs under triangles, must run on the thread owning the window's OpenGL context
+    void submit(sf::RenderWindow& window);
+
+    // Prepare, write every boid and submit on the calling thread
+    void draw(const Snapshot& frame, sf::RenderWindow& window);
+
+};
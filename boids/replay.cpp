@@ -0,0 +1,217 @@
+#include "boid.h"
+#include "flocks.h"
+#include "checkpoint.h"
+#include "runlog.h"
+#include "arguments.h"
+
+#include <string>
+#include <map>
+#include <sstream>
+
+// Replays a recorded run log, checking that the sequential flock reproduces the logged state hash after every update
+// and comparing an engine replaying the same log against it, bit for bit or within a tolerance
+// Usage: boids-replay --log file [--engine seq|naivecpu|cpu|sycl] [--threads n, 0 for one per hardware thread]
+//                     [--tolerance t, largest position or velocity difference accepted, 0 for identical state hashes]
+//                     [--steps n, stop after n updates]
+// Exits with 1 if the log could not be replayed or either check failed
+struct ReplayConfig {
+    std::string log;
+    std::string engine = "naivecpu";
+    unsigned int threads = 0;
+    float tolerance = 0;
+    long long steps = -1;
+};
+
+bool parseArguments(int argc, char* argv[], ReplayConfig& config) {
+    // Read `--key value` pairs, returning false on unknown keys or missing values
+
+    std::optional<std::map<std::string, std::string>> values = arguments::parse(argc, argv);
+
+    if (!values) {
+        return false;
+    }
+
+    for (const std::pair<const std::string, std::string>& value : *values) {
+        const std::string& key = value.first;
+        const std::string& v = value.second;
+
+        if (key == "log") {
+            config.log = v;
+        }
+        else if (key == "engine") {
+            config.engine = v;
+        }
+        else if (key == "threads") {
+            config.threads = std::stoul(v);
+        }
+        else if (key == "tolerance") {
+            config.tolerance = std::stof(v);
+        }
+        else if (key == "steps") {
+            config.steps = std::stoll(v);
+        }
+        else {
+            std::cerr << "Unknown option: --" << key << "\n";
+            return false;
+        }
+    }
+
+    if (config.log.empty() || config.tolerance < 0) {
+        std::cerr << "Invalid configuration\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ReplayConfig config;
+
+    if (!parseArguments(argc, argv, config)) {
+        return 1;
+    }
+
+    std::optional<runlog::Run> run = runlog::read(config.log);
+
+    if (!run) {
+        std::cerr << "Invalid or unreadable run log: " << config.log << "\n";
+        return 1;
+    }
+
+    std::optional<checkpoint::Header> header = checkpoint::inspect(run->checkpoint);
+
+    if (!header) {
+        std::cerr << "Invalid or unreadable starting checkpoint: " << run->checkpoint << "\n";
+        return 1;
+    }
+
+    if (header->seed != run->seed) {
+        std::cerr << "Run log's seed does not match its starting checkpoint: " << run->checkpoint << "\n";
+        return 1;
+    }
+
+    // Flocks start empty in the checkpoint's world and load its boids, weights and seed
+    auto dna = [](int) {
+        return Boid();
+    };
+
+    sf::Vector2u dimensions(header->width, header->height);
+    std::mt19937 gen;
+
+    Flock baseline(dna, 0, 2.f, 0.25f, 0.25f, gen, dimensions);
+
+    // Engine checked against the baseline, none when replaying the sequential flock alone
+    std::unique_ptr<Flock> flock;
+
+    if (config.engine == "naivecpu") {
+        flock = std::make_unique<NaiveCPUFlock>(dna, 0, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, config.threads);
+    }
+    else if (config.engine == "cpu") {
+        flock = std::make_unique<CPUFlock>(dna, 0, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, config.threads ? config.threads : 4);
+    }
+#ifdef BOIDS_SYCL
+    else if (config.engine == "sycl") {
+        std::unique_ptr<GPUFlock> gpu = std::make_unique<GPUFlock>(dna, 0, 2.f, 0.25f, 0.25f, gen, dimensions);
+        gpu->setDevice(sycl::device(sycl::default_selector_v));
+        flock = std::move(gpu);
+    }
+#endif
+    else if (config.engine != "seq") {
+        std::cerr << "Invalid or unavailable engine: " << config.engine << "\n";
+        return 1;
+    }
+
+    if (!checkpoint::load(baseline, run->checkpoint) || (flock && !checkpoint::load(*flock, run->checkpoint))) {
+        std::cerr << "Could not load starting checkpoint: " << run->checkpoint << "\n";
+        return 1;
+    }
+
+    // Engines log events to stdout, discard them so the report is the only output
+    std::ostringstream discarded;
+    std::streambuf* stdoutBuffer = std::cout.rdbuf(discarded.rdbuf());
+
+    // First update whose state differs from the log, and from the baseline
+    std::optional<std::uint64_t> logDivergence;
+    std::optional<std::uint64_t> engineDivergence;
+
+    runlog::Difference worst;
+    long long updates = 0;
+
+    for (const runlog::Entry& entry : run->entries) {
+        if (entry.type != runlog::Entry::Update) {
+            if (!runlog::apply(baseline, entry) || (flock && !runlog::apply(*flock, entry))) {
+                std::cout.rdbuf(stdoutBuffer);
+                std::cerr << "Logged input does not apply to the replayed flock after step " << baseline.step << "\n";
+                return 1;
+            }
+
+            continue;
+        }
+
+        if (config.steps >= 0 && updates >= config.steps) {
+            break;
+        }
+
+        updates++;
+        baseline.update(entry.deltaTime);
+
+        if (!logDivergence && runlog::stateHash(baseline) != entry.hash) {
+            logDivergence = baseline.step;
+        }
+
+        if (!flock) {
+            continue;
+        }
+
+        flock->update(entry.deltaTime);
+
+        // Identical state hashes, or every boid within tolerance
+        bool matched;
+
+        if (config.tolerance == 0) {
+            matched = runlog::stateHash(*flock) == runlog::stateHash(baseline);
+        }
+        else {
+            runlog::Difference difference = runlog::compare(baseline, *flock);
+
+            worst.position = std::max(worst.position, difference.position);
+            worst.velocity = std::max(worst.velocity, difference.velocity);
+            worst.leaders = std::max(worst.leaders, difference.leaders);
+            worst.mismatched = worst.mismatched || difference.mismatched;
+
+            matched = !difference.mismatched && difference.position <= config.tolerance && difference.velocity <= config.tolerance;
+        }
+
+        if (!engineDivergence && !matched) {
+            engineDivergence = baseline.step;
+        }
+    }
+
+    std::cout.rdbuf(stdoutBuffer);
+
+    std::cout << "Updates: " << updates << ", Steps: " << baseline.step << ", Boids: " << baseline.size << "\n";
+
+    if (logDivergence) {
+        std::cout << "Sequential replay diverged from the log at step " << *logDivergence << "\n";
+    }
+    else {
+        std::cout << "Sequential replay matched the log\n";
+    }
+
+    if (flock) {
+        if (engineDivergence) {
+            std::cout << "Engine " << config.engine << " diverged from the sequential flock at step " << *engineDivergence << "\n";
+        }
+        else {
+            std::cout << "Engine " << config.engine << " matched the sequential flock" <<
+                (config.tolerance == 0 ? " bit for bit" : " within " + std::to_string(config.tolerance)) << "\n";
+        }
+
+        if (config.tolerance > 0) {
+            std::cout << "Largest differences, Position: " << worst.position << ", Velocity: " << worst.velocity <<
+                ", Leaders: " << worst.leaders << (worst.mismatched ? ", boid counts or steps differed" : "") << "\n";
+        }
+    }
+
+    return logDivergence || engineDivergence ? 1 : 0;
+}
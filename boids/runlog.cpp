@@ -0,0 +1,261 @@
+#include "runlog.h"
+#include "checkpoint.h"
+#include "sfvec.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+
+namespace {
+    const char* magic = "boids-runlog";
+
+    // 64 bit FNV-1a over whole words, with a shift folding the high bits back down after each multiply
+    class Hasher {
+    private:
+        std::uint64_t hash = 0xcbf29ce484222325;
+
+    public:
+        void word(std::uint64_t value) {
+            this->hash = (this->hash ^ value) * 0x100000001b3;
+            this->hash ^= this->hash >> 32;
+        }
+
+        // Hash count values' bytes 8 at a time, the last word zero padded
+        template<typename T>
+        void array(const T* values, int count) {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+            std::size_t length = count * sizeof(T);
+
+            for (std::size_t offset = 0; offset < length; offset += sizeof(std::uint64_t)) {
+                std::uint64_t value = 0;
+                std::memcpy(&value, bytes + offset, std::min(sizeof(std::uint64_t), length - offset));
+                this->word(value);
+            }
+        }
+
+        std::uint64_t value() const {
+            return this->hash;
+        }
+    };
+
+    // Exact text form of a float or double, hex floats round trip every value
+    template<typename T>
+    std::string hex(T value) {
+        std::ostringstream text;
+        text << std::hexfloat << value;
+        return text.str();
+    }
+
+    // Read a hex float token, stream extraction of hex floats is not reliable across standard libraries
+    bool parse(std::istringstream& line, double& value) {
+        std::string token;
+
+        if (!(line >> token)) {
+            return false;
+        }
+
+        char* end = nullptr;
+        value = std::strtod(token.c_str(), &end);
+        return *end == '\0';
+    }
+
+    bool parse(std::istringstream& line, float& value) {
+        double wide;
+
+        if (!parse(line, wide)) {
+            return false;
+        }
+
+        value = static_cast<float>(wide);
+        return true;
+    }
+}
+
+std::uint64_t runlog::stateHash(Flock& flock) {
+    // Hash every simulation array of the live boids, in FlockState order
+
+    flock.readBack();
+
+    PROFILE_ZONE("hash");
+
+    const FlockState& state = flock.state;
+    int size = flock.size;
+
+    Hasher hasher;
+    hasher.word(flock.step);
+    hasher.word(size);
+    hasher.array(state.x.data(), size);
+    hasher.array(state.y.data(), size);
+    hasher.array(state.vx.data(), size);
+    hasher.array(state.vy.data(), size);
+    hasher.array(state.radius.data(), size);
+    hasher.array(state.visibility.data(), size);
+    hasher.array(state.leader.data(), size);
+    hasher.array(state.eccentricity.data(), size);
+    hasher.array(state.topSpeed.data(), size);
+    hasher.array(state.defaultTopSpeed.data(), size);
+    hasher.array(state.leaderSince.data(), size);
+
+    return hasher.value();
+}
+
+runlog::Difference runlog::compare(Flock& a, Flock& b) {
+    // Largest per-boid position and velocity differences and the number of boids whose leader flags differ
+
+    a.readBack();
+    b.readBack();
+
+    Difference difference;
+
+    if (a.size != b.size || a.step != b.step) {
+        difference.mismatched = true;
+        return difference;
+    }
+
+    float width = a.dimensions.x;
+    float height = a.dimensions.y;
+
+    for (int i = 0; i < a.size; i++) {
+        float dx = std::fabs(sfvec::wrapWithin(a.state.x[i] - b.state.x[i], width));
+        float dy = std::fabs(sfvec::wrapWithin(a.state.y[i] - b.state.y[i], height));
+        float dvx = std::fabs(a.state.vx[i] - b.state.vx[i]);
+        float dvy = std::fabs(a.state.vy[i] - b.state.vy[i]);
+
+        difference.position = std::max({ difference.position, dx, dy });
+        difference.velocity = std::max({ difference.velocity, dvx, dvy });
+        difference.leaders += a.state.leader[i] != b.state.leader[i];
+    }
+
+    return difference;
+}
+
+bool runlog::apply(Flock& flock, const Entry& entry) {
+    // Make the same call the recorder made, a remove of a boid the flock does not have means the replay already diverged
+
+    switch (entry.type) {
+    case Entry::PerCluster:
+        flock.setPerCluster(entry.perCluster);
+        return true;
+    case Entry::Add:
+        flock.add(entry.boid);
+        return true;
+    case Entry::Remove:
+        if (entry.index < 0 || entry.index >= flock.size) {
+            return false;
+        }
+
+        flock.remove(entry.index);
+        return true;
+    default:
+        return true;
+    }
+}
+
+std::optional<runlog::Run> runlog::read(const std::string& path) {
+    // Parse the header, then one entry per line, rejecting the log at the first malformed line
+
+    std::ifstream file(path);
+    std::string text;
+    Run run;
+
+    // Header, magic and version, the starting checkpoint and the seed
+    int logVersion = 0;
+
+    if (!(file >> text >> logVersion) || text != magic || logVersion != version) {
+        return std::nullopt;
+    }
+
+    if (!(file >> text) || text != "checkpoint" || !(file >> std::ws && std::getline(file, run.checkpoint)) ||
+        !(file >> text >> std::hex >> run.seed >> std::dec) || text != "seed") {
+        return std::nullopt;
+    }
+
+    // The checkpoint is named relative to the log
+    run.checkpoint = (std::filesystem::path(path).parent_path() / run.checkpoint).string();
+
+    while (std::getline(file, text)) {
+        std::istringstream line(text);
+        std::string kind;
+
+        if (!(line >> kind)) {
+            continue;
+        }
+
+        Entry entry;
+        bool valid = false;
+
+        if (kind == "update") {
+            entry.type = Entry::Update;
+            valid = parse(line, entry.deltaTime) && static_cast<bool>(line >> std::hex >> entry.hash);
+        }
+        else if (kind == "cluster") {
+            entry.type = Entry::PerCluster;
+            valid = static_cast<bool>(line >> entry.perCluster);
+        }
+        else if (kind == "add") {
+            entry.type = Entry::Add;
+            Boid& boid = entry.boid;
+            valid = parse(line, boid.position.x) && parse(line, boid.position.y) && parse(line, boid.velocity.x) &&
+                parse(line, boid.velocity.y) && parse(line, boid.radius) && parse(line, boid.topSpeed) && parse(line, boid.visibility);
+        }
+        else if (kind == "remove") {
+            entry.type = Entry::Remove;
+            valid = static_cast<bool>(line >> entry.index);
+        }
+
+        if (!valid) {
+            return std::nullopt;
+        }
+
+        run.entries.push_back(entry);
+    }
+
+    return run;
+}
+
+RunRecorder::RunRecorder(const std::string& path, Flock& flock) :
+    log(path) {
+    // Checkpoint the starting flock next to the log, then write the header
+
+    std::string start = path + ".boids";
+
+    if (!checkpoint::save(flock, start)) {
+        this->log.setstate(std::ios::failbit);
+        return;
+    }
+
+    this->log << magic << " " << runlog::version << "\n" <<
+        "checkpoint " << std::filesystem::path(start).filename().string() << "\n" <<
+        "seed " << std::hex << flock.seed << std::dec << "\n";
+}
+
+void RunRecorder::update(Flock& flock, double deltaTime) {
+    // Hashing reads back engines stepping elsewhere, so recording costs GPUFlock a wait and a download per update
+    // Flushed every update, so the log of a run that crashes or exits without unwinding is complete up to its last step
+
+    flock.update(deltaTime);
+
+    this->log << "update " << hex(deltaTime) << " " << std::hex << runlog::stateHash(flock) << std::dec << std::endl;
+}
+
+void RunRecorder::setPerCluster(Flock& flock, bool perCluster) {
+    flock.setPerCluster(perCluster);
+
+    this->log << "cluster " << perCluster << "\n";
+}
+
+int RunRecorder::add(Flock& flock, const Boid& boid) {
+    int index = flock.add(boid);
+
+    this->log << "add " << hex(boid.position.x) << " " << hex(boid.position.y) << " " << hex(boid.velocity.x) << " " <<
+        hex(boid.velocity.y) << " " << hex(boid.radius) << " " << hex(boid.topSpeed) << " " << hex(boid.visibility) << "\n";
+
+    return index;
+}
+
+void RunRecorder::remove(Flock& flock, int index) {
+    flock.remove(index);
+
+    this->log << "remove " << index << "\n";
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "flocks.h"
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Record and replay of whole simulation runs
+// A run log holds everything a run's result depends on: its starting flock as a checkpoint (boids, world, weights and
+// the random seed), then in order every update's deltaTime and every input that changed the flock between updates
+// Each update also logs a hash of the flock's state, so a replay can check it reproduces the run step by step and
+// an engine can be checked against the sequential flock replaying the same log
+// Logs are text, one entry per line, with deltaTimes and boid values written as hex floats so they read back exactly
+namespace runlog {
+    // Format version, bumped whenever an entry's layout changes
+    const int version = 1;
+
+    // 64 bit hash of the live boids' simulation state and the step, render-only data is not included
+    // Engines stepping elsewhere are read back first
+    std::uint64_t stateHash(Flock& flock);
+
+    // Largest differences between two flocks' boids, positions measured across the world's wrapped edges
+    struct Difference {
+        float position = 0;
+        float velocity = 0;
+        int leaders = 0;
+
+        // Boid counts or steps differ, nothing else is compared
+        bool mismatched = false;
+    };
+
+    Difference compare(Flock& a, Flock& b);
+
+    // One logged entry
+    struct Entry {
+        enum Type {
+            Update,
+            PerCluster,
+            Add,
+            Remove
+        };
+
+        Type type = Update;
+
+        // Update
+        double deltaTime = 0;
+        std::uint64_t hash = 0;
+
+        // PerCluster
+        bool perCluster = false;
+
+        // Add
+        Boid boid;
+
+        // Remove
+        int index = 0;
+    };
+
+    // Replay an input entry onto a flock, updates are left to the caller
+    // Returns false, leaving the flock unchanged, if the entry does not apply to it
+    bool apply(Flock& flock, const Entry& entry);
+
+    // A parsed log
+    struct Run {
+        // Checkpoint of the starting flock and the random seed stored in it, replays check the two agree
+        std::string checkpoint;
+        std::uint64_t seed = 0;
+
+        std::vector<Entry> entries;
+    };
+
+    // Parse a log, empty if it can not be read or is not a log of this version
+    std::optional<Run> read(const std::string& path);
+}
+
+// Logs a run as it happens
+// Inputs go through the recorder, which applies them to the flock and logs them, so the log sees every change in order
+class RunRecorder {
+private:
+    std::ofstream log;
+
+public:
+    // Start logging flock's run to path, checkpointing its current state to path + ".boids" as the starting flock
+    RunRecorder(const std::string& path, Flock& flock);
+
+    // Whether the checkpoint and every entry so far were written
+    bool good() const {
+        return static_cast<bool>(this->log);
+    }
+
+    // Update the flock and log the deltaTime and resulting state hash
+    void update(Flock& flock, double deltaTime);
+
+    // Inputs, applied then logged
+    void setPerCluster(Flock& flock, bool perCluster);
+    int add(Flock& flock, const Boid& boid);
+    void remove(Flock& flock, int index);
+};
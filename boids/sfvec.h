@@ -11,8 +11,14 @@
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <limits>
+#include <cstdint>
+#include <concepts>
 
+// SYCL is only required by GPUFlock, builds without a SYCL compiler leave BOIDS_SYCL undefined
+#ifdef BOIDS_SYCL
 #include <CL/sycl.hpp>
+#endif
 
 // Vector math functions for SFML vectors
 namespace sfvec {
@@ -38,89 +44,132 @@ namespace sfvec {
 
     // Return dot product of two vectors
     template<typename T>
-    float dot(sf::Vector2<T> a, sf::Vector2<T> b) {
+    constexpr float dot(sf::Vector2<T> a, sf::Vector2<T> b) {
         return (a.x * b.x) + (a.y * b.y);
     }
 
+    // Squared magnitude of vector, for comparisons that do not need the square root
+    template<typename T>
+    constexpr T getMagnitudeSquared(const sf::Vector2<T>& v) {
+        return (v.x * v.x) + (v.y * v.y);
+    }
+
+    // Squared distance between two vectors
+    template<typename T>
+    constexpr T getDistanceSquared(const sf::Vector2<T>& a, const sf::Vector2<T>& b) {
+        return sfvec::getMagnitudeSquared(b - a);
+    }
+
+    // Reciprocal square root, a correctly rounded square root and division rather than a hardware estimate,
+    // estimates differ between instruction sets and devices and the engines must step boids identically
+    template<typename T>
+    T rsqrt(T x) {
+        return T(1) / sqrt(x);
+    }
+
+    // Round to the nearest integer, halves to even, for floating point values below 2^(mantissa bits - 2)
+    // Adding and subtracting 1.5 * 2^mantissa bits leaves no fraction bits for the sum, so the FPU's own rounding does the work
+    // in straight line code, without the library call round makes on x86-64 without SSE4.1
+    // Relies on IEEE arithmetic, fast math models may fold the two operations away
+    template<typename T> requires std::floating_point<T>
+    constexpr T roundNearest(T x) {
+        constexpr T magic = T(3) * T(std::uint64_t(1) << (std::numeric_limits<T>::digits - 2));
+
+        return (x + magic) - magic;
+    }
+
+    // Minimum image of an offset along a looping axis of a length, the equivalent offset within half a length of 0
+    // Branchless x - L * round(x / L), loops can pass the length's reciprocal in to save a division
+    // Only for floating point T, an integer reciprocal truncates to 0 and would leave every offset unwrapped
+    template<typename T> requires std::floating_point<T>
+    constexpr T wrap(T offset, T length, T inverseLength) {
+        return offset - length * sfvec::roundNearest(offset * inverseLength);
+    }
+
+    template<typename T> requires std::floating_point<T>
+    constexpr T wrap(T offset, T length) {
+        return sfvec::wrap(offset, length, T(1) / length);
+    }
+
+    // Minimum image of an offset already within a length of 0, such as between two points inside the world
+    // Compares instead of rounding, cheaper wherever few offsets cross an edge since the branches are then well predicted
+    template<typename T>
+    constexpr T wrapWithin(T offset, T length) {
+        T half = length / 2;
+
+        return offset > half ? offset - length : (offset < -half ? offset + length : offset);
+    }
+
+    // Minimum image of an offset in a toroidal space
+    template<typename T> requires std::floating_point<T>
+    sf::Vector2<T> wrap(const sf::Vector2<T>& offset, const sf::Vector2u& dimensions) {
+        return sf::Vector2<T>(sfvec::wrap(offset.x, static_cast<T>(dimensions.x)), sfvec::wrap(offset.y, static_cast<T>(dimensions.y)));
+    }
+
     // Get distance between two vectors
     template<typename T>
     float getDistance(const sf::Vector2<T>& a, const sf::Vector2<T>& b) {
-        return sqrt(pow((b.x - a.x), 2) + pow(b.y - a.y, 2));
+        return sqrt(sfvec::getDistanceSquared(a, b));
     }
 
-    // Get relative position of a vector in a toroidal space in relation to another vector
+    // Get relative position of a vector in a toroidal space in relation to another vector, its avatar closest to it
     // Credit to Andrew D. Hwang, question asked by me (https://math.stackexchange.com/questions/4874108/getting-closest-relative-position-of-a-point-in-a-toroidal-space)
-    template<typename T>
+    // The closest of the four avatars is the one reached by the minimum image of the offset between the points
+    template<typename T> requires std::floating_point<T>
     sf::Vector2<T> getRelativeToroidalPosition(const sf::Vector2<T>& of, const sf::Vector2<T>& to, const sf::Vector2u& dimensions) {
-        // Determine direction to other point
-        int m = -sgn(of.x - to.x);
-        int n = -sgn(of.y - to.y);
-
-        // Calculate avatars of other point `of` in relation to `to`
-        sf::Vector2<T> avatars[4];
-        avatars[0] = of;
-        avatars[1] = of + sf::Vector2<T>(m * dimensions.x, 0);
-        avatars[2] = of + sf::Vector2<T>(0, n * dimensions.y);
-        avatars[3] = of + sf::Vector2<T>(m * dimensions.x, n * dimensions.y);
-
-        int closest = 0;
-
-        // Find minimum distance
-        for (int i = 1; i < 4; i++) {
-            float distance = sfvec::getDistance(to, avatars[i]);
-            float closestDistance = sfvec::getDistance(to, avatars[closest]);
-
-            if (distance < closestDistance) {
-                closest = i;
-            }
-        }
+        return to + sfvec::wrap(of - to, dimensions);
+    }
 
-        // Return closest avatar
-        return avatars[closest];
+    // Get squared distance between two vectors in a toroidal space
+    template<typename T> requires std::floating_point<T>
+    T getToroidalDistanceSquared(const sf::Vector2<T>& a, const sf::Vector2<T>& b, const sf::Vector2u& dimensions) {
+        return sfvec::getMagnitudeSquared(sfvec::wrap(b - a, dimensions));
     }
 
     // Get distance between two vectors in a toroidal space
-    template<typename T>
+    template<typename T> requires std::floating_point<T>
     float getToroidalDistance(const sf::Vector2<T>& a, const sf::Vector2<T>& b, const sf::Vector2u& dimensions) {
-        // Get distances of vector components in each dimension
-        float dx = abs(b.x - a.x);
-        float dy = abs(b.y - a.y);
-
-        // If the distance is greater than half the dimension's total length,
-        // it is shorter to go the opposite direction, thus the real distance is the dimension - previous distance
-        if (dx > (dimensions.x / 2)) {
-            dx = dimensions.x - dx;
-        }
-
-        if (dy > (dimensions.y / 2)) {
-            dy = dimensions.y - dy;
-        }
-
-        // Return true distance
-        return sqrt(pow(dx, 2) + pow(dy, 2));
+        return sqrt(sfvec::getToroidalDistanceSquared(a, b, dimensions));
     }
 
     // Get magnitude of vector
     template<typename T>
     float getMagnitude(const sf::Vector2<T>& v) {
-        return sqrt(pow(v.x, 2) + pow(v.y, 2));
+        return sqrt(sfvec::getMagnitudeSquared(v));
     }
 
-    // Normalize vector
+    // Normalize vector, zero vectors have no direction and stay zero
     template<typename T>
     sf::Vector2<T> normalize(const sf::Vector2<T>& v) {
-        sf::Vector2<T> normalized = v / sfvec::getMagnitude(v);
+        T magnitudeSquared = sfvec::getMagnitudeSquared(v);
 
-        return normalized;
+        return magnitudeSquared > 0 ? v * sfvec::rsqrt(magnitudeSquared) : v;
     }
 
     // Clamp vector magnitude to max
     template<typename T>
     sf::Vector2<T> clampMagnitude(const sf::Vector2<T>& v, T max) {
-        return sfvec::getMagnitude(v) > max ? sfvec::normalize(v) * max : v;
+        T magnitudeSquared = sfvec::getMagnitudeSquared(v);
+
+        return magnitudeSquared > max * max ? v * (max * sfvec::rsqrt(magnitudeSquared)) : v;
+    }
+
+    // Approximate atan2 in radians, within about 1e-5 of atan2 and NaN when x and y are both 0
+    // Hastings' polynomial of atan over [0, 1], mirrored into the other octants
+    inline float fastAtan2(float y, float x) {
+        float ax = fabs(x);
+        float ay = fabs(y);
+        float a = fmin(ax, ay) / fmax(ax, ay);
+        float s = a * a;
+        float r = a * (0.999866f + s * (-0.3302995f + s * (0.180141f + s * (-0.085133f + s * 0.0208351f))));
+
+        r = ay > ax ? 1.57079637f - r : r;
+        r = x < 0 ? 3.14159274f - r : r;
+
+        return y < 0 ? -r : r;
     }
 
-    // Get rotation of vector
+    // Get rotation of vector in degrees, atan(-y / x) so headings lie in the half plane of positive x
     template<typename T>
     float getRotation(const sf::Vector2<T>& v) {
         // Handle v.x being 0, to avoid zero division
@@ -136,7 +185,8 @@ namespace sfvec {
             }
         }
         else {
-            return atan((-1 * v.y) / v.x) * TO_DEGREES;
+            // atan(-y / x) is atan2 of the vector flipped into positive x
+            return sfvec::fastAtan2(v.x < 0 ? v.y : -v.y, fabs(v.x)) * TO_DEGREES;
         }
     }
 
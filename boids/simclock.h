@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+
+// Fixed timestep simulation clock
+// Real frame time is added to an accumulator and spent in whole steps, so the simulation always advances by the same
+// deltaTime however fast or slow frames are, several steps may run in one slow frame and none in a fast one
+// Leftover time carries over to the next frame instead of being rounded away
+class SimulationClock {
+private:
+    double step;
+    double accumulator = 0;
+
+    // Most steps taken in one frame, if the simulation cannot keep up the excess time is dropped
+    // instead of queueing ever more steps into later frames
+    int maxSteps;
+
+public:
+    SimulationClock(double step = 1 / 60.0, int maxSteps = 8) :
+        step(step), maxSteps(maxSteps) {}
+
+    // Simulated seconds per step, the deltaTime every update is called with
+    double timestep() const {
+        return this->step;
+    }
+
+    // Add a frame's real elapsed seconds and return the number of steps now due
+    int advance(double frameTime) {
+        this->accumulator += frameTime;
+
+        int steps = static_cast<int>(this->accumulator / this->step);
+
+        // Drop time the simulation can not catch up on
+        if (steps > this->maxSteps) {
+            steps = this->maxSteps;
+            this->accumulator = 0;
+        }
+        else {
+            this->accumulator -= steps * this->step;
+        }
+
+        return steps;
+    }
+
+    // Real seconds until the next step is due
+    double untilNextStep() const {
+        return std::max(0.0, this->step - this->accumulator);
+    }
+};
@@ -0,0 +1,231 @@
+#include "simd.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BOIDS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC and Clang need per-function target attributes to emit AVX2 without compiling the whole program for it, MSVC does not
+#if defined(BOIDS_X86) && !defined(_MSC_VER)
+#define BOIDS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BOIDS_TARGET_AVX2
+#endif
+
+namespace simd {
+
+    // Minimum image of a coordinate difference on a ring of `length`
+    static inline float wrap(float d, float length) {
+        d = std::fabs(d);
+        return std::min(d, length - d);
+    }
+
+    int visibleScalar(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out) {
+        int found = 0;
+
+        for (int k = 0; k < count; k++) {
+            float dx = wrap(xs[k] - x, width);
+            float dy = wrap(ys[k] - y, height);
+
+            // Always write, only advance when visible, to keep the loop branch free
+            out[found] = k;
+            found += (dx * dx + dy * dy) < radiusSquared;
+        }
+
+        return found;
+    }
+
+#ifdef BOIDS_X86
+    static inline int countTrailingZeros(unsigned int v) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, v);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(v);
+#endif
+    }
+
+    // Append offsets of set mask bits to out
+    static inline int compact(unsigned int mask, int base, int* out, int found) {
+        while (mask) {
+            out[found++] = base + countTrailingZeros(mask);
+            mask &= mask - 1;
+        }
+
+        return found;
+    }
+
+    // Finish the candidates that do not fill a whole vector iteration with the scalar kernel
+    static inline int tail(float x, float y, float radiusSquared, const float* xs, const float* ys, int k, int count, float width, float height, int* out, int found) {
+        int extra = visibleScalar(x, y, radiusSquared, xs + k, ys + k, count - k, width, height, out + found);
+
+        for (int t = 0; t < extra; t++) {
+            out[found + t] += k;
+        }
+
+        return found + extra;
+    }
+
+    static inline __m128 squaredDistanceSSE(__m128 px, __m128 py, const float* xs, const float* ys, __m128 w, __m128 h) {
+        const __m128 signMask = _mm_set1_ps(-0.f);
+
+        // |d| by clearing the sign bit, then min(|d|, L - |d|) for the minimum image
+        __m128 dx = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(xs), px));
+        __m128 dy = _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(ys), py));
+        dx = _mm_min_ps(dx, _mm_sub_ps(w, dx));
+        dy = _mm_min_ps(dy, _mm_sub_ps(h, dy));
+
+        return _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    }
+
+    int visibleSSE(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out) {
+        __m128 px = _mm_set1_ps(x);
+        __m128 py = _mm_set1_ps(y);
+        __m128 w = _mm_set1_ps(width);
+        __m128 h = _mm_set1_ps(height);
+        __m128 r2 = _mm_set1_ps(radiusSquared);
+
+        int found = 0;
+        int k = 0;
+
+        for (; k + 8 <= count; k += 8) {
+            __m128 lo = _mm_cmplt_ps(squaredDistanceSSE(px, py, xs + k, ys + k, w, h), r2);
+            __m128 hi = _mm_cmplt_ps(squaredDistanceSSE(px, py, xs + k + 4, ys + k + 4, w, h), r2);
+
+            unsigned int mask = _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4);
+            found = compact(mask, k, out, found);
+        }
+
+        return tail(x, y, radiusSquared, xs, ys, k, count, width, height, out, found);
+    }
+
+    BOIDS_TARGET_AVX2 static inline __m256 squaredDistanceAVX2(__m256 px, __m256 py, const float* xs, const float* ys, __m256 w, __m256 h) {
+        const __m256 signMask = _mm256_set1_ps(-0.f);
+
+        // |d| by clearing the sign bit, then min(|d|, L - |d|) for the minimum image
+        __m256 dx = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(xs), px));
+        __m256 dy = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(ys), py));
+        dx = _mm256_min_ps(dx, _mm256_sub_ps(w, dx));
+        dy = _mm256_min_ps(dy, _mm256_sub_ps(h, dy));
+
+        // Separate multiply and add (no FMA), matching the scalar and SSE rounding exactly
+        return _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    }
+
+    BOIDS_TARGET_AVX2 int visibleAVX2(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out) {
+        __m256 px = _mm256_set1_ps(x);
+        __m256 py = _mm256_set1_ps(y);
+        __m256 w = _mm256_set1_ps(width);
+        __m256 h = _mm256_set1_ps(height);
+        __m256 r2 = _mm256_set1_ps(radiusSquared);
+
+        int found = 0;
+        int k = 0;
+
+        for (; k + 16 <= count; k += 16) {
+            __m256 lo = _mm256_cmp_ps(squaredDistanceAVX2(px, py, xs + k, ys + k, w, h), r2, _CMP_LT_OQ);
+            __m256 hi = _mm256_cmp_ps(squaredDistanceAVX2(px, py, xs + k + 8, ys + k + 8, w, h), r2, _CMP_LT_OQ);
+
+            unsigned int mask = _mm256_movemask_ps(lo) | (_mm256_movemask_ps(hi) << 8);
+            found = compact(mask, k, out, found);
+        }
+
+        return tail(x, y, radiusSquared, xs, ys, k, count, width, height, out, found);
+    }
+
+    static void cpuid(int info[4], int leaf, int subleaf) {
+#ifdef _MSC_VER
+        __cpuidex(info, leaf, subleaf);
+#else
+        unsigned int a, b, c, d;
+        __cpuid_count(leaf, subleaf, a, b, c, d);
+        info[0] = a;
+        info[1] = b;
+        info[2] = c;
+        info[3] = d;
+#endif
+    }
+
+    static unsigned long long xgetbv(unsigned int index) {
+#ifdef _MSC_VER
+        return _xgetbv(index);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+
+    Level detect() {
+        int info[4];
+        cpuid(info, 0, 0);
+        int maxLeaf = info[0];
+
+        cpuid(info, 1, 0);
+        bool sse2 = info[3] & (1 << 26);
+        bool osxsave = info[2] & (1 << 27);
+        bool avx = info[2] & (1 << 28);
+
+        // AVX2 also needs the OS to save YMM registers on context switches (XCR0 bits 1 and 2)
+        if (maxLeaf >= 7 && osxsave && avx && (xgetbv(0) & 0x6) == 0x6) {
+            cpuid(info, 7, 0);
+
+            if (info[1] & (1 << 5)) {
+                return Level::AVX2;
+            }
+        }
+
+        return sse2 ? Level::SSE : Level::Scalar;
+    }
+#else
+    // Non-x86 builds only have the scalar kernel
+    int visibleSSE(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out) {
+        return visibleScalar(x, y, radiusSquared, xs, ys, count, width, height, out);
+    }
+
+    int visibleAVX2(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out) {
+        return visibleScalar(x, y, radiusSquared, xs, ys, count, width, height, out);
+    }
+
+    Level detect() {
+        return Level::Scalar;
+    }
+#endif
+
+    VisibilityKernel kernel(Level level) {
+        switch (level) {
+        case Level::AVX2:
+            return visibleAVX2;
+        case Level::SSE:
+            return visibleSSE;
+        default:
+            return visibleScalar;
+        }
+    }
+
+    const char* name(Level level) {
+        switch (level) {
+        case Level::AVX2:
+            return "AVX2";
+        case Level::SSE:
+            return "SSE";
+        default:
+            return "Scalar";
+        }
+    }
+
+    VisibilityKernel visible() {
+        // Thread safe one time detection
+        static const VisibilityKernel selected = kernel(detect());
+        return selected;
+    }
+}
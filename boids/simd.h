@@ -0,0 +1,37 @@
+#pragma once
+
+// Vectorized neighbour tests, the fastest kernel supported by the running CPU is selected once at runtime with CPUID
+namespace simd {
+
+    // Tests the boid at (x, y) against `count` candidates stored in xs/ys
+    // Writes the offsets (0 to count - 1) of candidates whose toroidal squared distance is below radiusSquared to `out` in ascending order,
+    // `out` must have room for `count` offsets, returns the number of offsets written
+    // All kernels use the same branchless minimum-image arithmetic, so they produce identical visibility sets
+    typedef int (*VisibilityKernel)(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out);
+
+    // Instruction set levels, in increasing order of width
+    enum class Level {
+        Scalar,
+        SSE,
+        AVX2
+    };
+
+    // Portable fallback, one candidate at a time
+    int visibleScalar(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out);
+
+    // SSE, 8 candidates per iteration (2x4 lanes)
+    int visibleSSE(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out);
+
+    // AVX2, 16 candidates per iteration (2x8 lanes)
+    int visibleAVX2(float x, float y, float radiusSquared, const float* xs, const float* ys, int count, float width, float height, int* out);
+
+    // Highest level supported by the CPU and operating system
+    Level detect();
+
+    // Kernel and name for a level
+    VisibilityKernel kernel(Level level);
+    const char* name(Level level);
+
+    // Fastest supported kernel, detected on first call
+    VisibilityKernel visible();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Immutable render inputs of one published step, everything the renderer needs without touching the flock
+// Filled by the simulation once per step, then only read, so a render thread can draw it while the next step runs
+struct Snapshot {
+    // Step the snapshot was taken after
+    std::uint64_t step = 0;
+
+    // Boids in the snapshot, per-boid arrays are indexed by boid id
+    int size = 0;
+
+    // Position
+    std::vector<float> x;
+    std::vector<float> y;
+
+    // Heading in degrees, the last defined heading for stopped boids
+    std::vector<float> heading;
+
+    // Triangle and visibility disc radii
+    std::vector<float> radius;
+    std::vector<float> visibilityRadius;
+
+    // Escaping boids are drawn red
+    std::vector<std::uint8_t> leader;
+
+    // Size arrays for count boids, only growing so recycled snapshots do not reallocate
+    void resize(int count) {
+        this->size = count;
+
+        if (static_cast<int>(this->x.size()) < count) {
+            this->x.resize(count);
+            this->y.resize(count);
+            this->heading.resize(count);
+            this->radius.resize(count);
+            this->visibilityRadius.resize(count);
+            this->leader.resize(count);
+        }
+    }
+};
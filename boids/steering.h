@@ -0,0 +1,219 @@
+#pragma once
+
+#include "sfvec.h"
+#include "philox.h"
+
+#include <cstdint>
+#include <bit>
+
+// Per-boid steering, leadership and integration math over raw state arrays
+// Shared by the host engines and GPUFlock's kernels so both step boids with the same arithmetic,
+// header only and free of library state so it can be called from device code
+
+// Totals over a boid's visible list, gathered in a single pass
+struct NeighbourSums {
+    // Number of visible boids
+    int count = 0;
+
+    // Sum of inverse square distance weighted directions away from visible non-leaders
+    sf::Vector2f separation = sf::Vector2f(0.f, 0.f);
+
+    // Average position of visible boids' nearest avatars to self
+    sf::Vector2f centre = sf::Vector2f(0.f, 0.f);
+
+    // Average position of own nearest avatars to each visible boid
+    sf::Vector2f eccentricityCentre = sf::Vector2f(0.f, 0.f);
+
+    // Velocity average of visible non-leaders, plus the leader's backwards push
+    sf::Vector2f alignment = sf::Vector2f(0.f, 0.f);
+
+    // First visible leader, its avatar and velocity replace cohesion's centre and alignment
+    bool leaderVisible = false;
+    sf::Vector2f leaderPosition = sf::Vector2f(0.f, 0.f);
+    sf::Vector2f leaderVelocity = sf::Vector2f(0.f, 0.f);
+};
+
+// Read-only pointers to the state arrays steering reads, from a FlockState on the host or device buffers
+struct StateView {
+    const float* x;
+    const float* y;
+    const float* vx;
+    const float* vy;
+    const std::uint8_t* leader;
+
+    sf::Vector2f position(int i) const {
+        return sf::Vector2f(this->x[i], this->y[i]);
+    }
+
+    sf::Vector2f velocity(int i) const {
+        return sf::Vector2f(this->vx[i], this->vy[i]);
+    }
+};
+
+namespace steering {
+
+    // Walk a visible list once, computing each pair's toroidal offset and distance a single time
+    inline NeighbourSums accumulate(const StateView& state, int i, const int* visible, int visibleCount, float width, float height) {
+        NeighbourSums sums;
+        sums.count = visibleCount;
+
+        if (sums.count == 0) {
+            return sums;
+        }
+
+        sf::Vector2f position = state.position(i);
+        sf::Vector2f velocity = state.velocity(i);
+        float inverseCount = 1.f / (float)sums.count;
+        bool selfLeader = state.leader[i];
+
+        for (int k = 0; k < visibleCount; k++) {
+            int other = visible[k];
+            sf::Vector2f otherPosition = state.position(other);
+            sf::Vector2f otherVelocity = state.velocity(other);
+
+            // Offset to the other boid's avatar nearest to self (minimum image), self's avatar nearest to it is the opposite offset
+            // Visible boids are mostly in the same flock away from the edges, so comparing beats wrapping by rounding here
+            sf::Vector2f offset = sf::Vector2f(sfvec::wrapWithin(otherPosition.x - position.x, width),
+                sfvec::wrapWithin(otherPosition.y - position.y, height));
+            sf::Vector2f otherAvatar = position + offset;
+            sf::Vector2f selfAvatar = otherPosition - offset;
+            float distanceSquared = sfvec::getMagnitudeSquared(offset);
+
+            // Separation, direction away from the other boid weighted by inverse square distance, leaders are not avoided
+            // The unit direction over the squared distance is the offset over the cubed distance
+            if (!state.leader[other]) {
+                sums.separation -= offset * (1.f / (distanceSquared * sqrt(distanceSquared)));
+            }
+
+            // Cohesion and escape centroid, eccentricity centroid
+            sums.centre += otherAvatar * inverseCount;
+            sums.eccentricityCentre += selfAvatar * inverseCount;
+
+            // Alignment stops accumulating at the first visible leader, which replaces it
+            if (!sums.leaderVisible) {
+                sf::Vector2f force = otherVelocity * inverseCount;
+
+                if (selfLeader && sfvec::dot(velocity, otherVelocity) > 0) {
+                    sums.alignment += force * -0.6f;
+                }
+
+                if (!state.leader[other]) {
+                    // Calculate alignment as the average velocity of visible boids
+                    sums.alignment += force;
+                }
+                else {
+                    sums.leaderVisible = true;
+                    sums.leaderPosition = otherAvatar;
+                    sums.leaderVelocity = otherVelocity;
+                }
+            }
+        }
+
+        return sums;
+    }
+
+    // Separation force, scaled by the amount of visible boids
+    inline sf::Vector2f separation(const NeighbourSums& sums) {
+        return sums.separation * (float)sums.count;
+    }
+
+    // Cohesion force towards the first visible leader, otherwise the average position of visible boids
+    // Divided by the number of boids to ensure consistent cohesion despite density of flock
+    inline sf::Vector2f cohesion(const NeighbourSums& sums, sf::Vector2f position) {
+        if (sums.count == 0) {
+            return sf::Vector2f(0.f, 0.f);
+        }
+
+        sf::Vector2f centre = sums.leaderVisible ? sums.leaderPosition : sums.centre;
+
+        return sfvec::normalize(centre - position) / (float)sums.count;
+    }
+
+    // Alignment force, following the first visible leader outright
+    inline sf::Vector2f alignment(const NeighbourSums& sums) {
+        return sums.leaderVisible ? sums.leaderVelocity : sums.alignment;
+    }
+
+    // Eccentricity using Felipe Takaoka's formula, a Gaussian-kernel-like distribution of the eccentricity centroid's distance
+    // ~0 when surrounded by other boids, closer to 1 near the edge of the flock, 0 when no boids are visible
+    inline float eccentricity(const NeighbourSums& sums, float radius, float visibility) {
+        if (sums.count == 0) {
+            return 0.f;
+        }
+
+        float visibilityRadius = visibility * radius;
+
+        float t = radius + ((visibilityRadius - radius) / 2.f); // Midpoint distance between boid and visibility radius
+        float sigma = (visibilityRadius - radius) * 8.f; // Tuning value for eccentricity formula
+
+        float deviation = sfvec::getMagnitude(sums.eccentricityCentre) - t;
+
+        return exp(-(deviation * deviation) / (2.f * sigma * sigma));
+    }
+
+    // Chance of escaping, eccentricity multiplied by the front back axis
+    // The axis is the dot product of the normalized direction away from the centroid and the normalized velocity,
+    // closer to -1 nearer to the back of the flock and to 1 nearer to the front, so boids at the back never escape
+    inline float escapeChance(const NeighbourSums& sums, sf::Vector2f position, sf::Vector2f velocity, float eccentricity) {
+        float frontBackAxis = sfvec::dot(sfvec::normalize(position - sums.centre), sfvec::normalize(velocity));
+
+        return frontBackAxis * eccentricity;
+    }
+
+    // Escape threshold uniform in [0.85, 1), drawn from the boid's own stream for the step
+    inline float escapeThreshold(std::uint64_t seed, int i, std::uint64_t step) {
+        return 0.85f + 0.15f * philox::uniform(seed, i, step, philox::Escape);
+    }
+
+    // Top speed multiplier t seconds into leadership, following the acceleration curve: https://www.desmos.com/calculator/pd0gtqrvbw
+    inline float escapeAcceleration(float t) {
+        float curve = tanh((2.25f * pow(t, -0.4f)) - 3.f);
+
+        return -(curve * curve) + 2.f;
+    }
+
+    // Milliseconds a boid promoted at step since has led for at step, in single precision so kernels need no fp64
+    inline float leaderTime(std::uint64_t since, std::uint64_t step, float timestep) {
+        return static_cast<float>(step - since) * (timestep * 1000.f);
+    }
+
+    // Leadership claim key, (escape margin bits << 32 | ~id) so larger margins and then lower ids compare greater
+    // Positive float bits order like the floats themselves
+    inline unsigned long long claimKey(int i, float margin) {
+        return (static_cast<unsigned long long>(std::bit_cast<std::uint32_t>(margin)) << 32) | static_cast<std::uint32_t>(~i);
+    }
+
+    // Id of the boid holding a claim key
+    inline int claimant(unsigned long long key) {
+        return static_cast<int>(~static_cast<std::uint32_t>(key));
+    }
+
+    // Apply weighted steering forces to a velocity and clamp it to top speed
+    inline sf::Vector2f steer(sf::Vector2f velocity, sf::Vector2f separation, sf::Vector2f cohesion, sf::Vector2f alignment,
+        float sWeight, float cWeight, float aWeight, float topSpeed) {
+        velocity = velocity + (separation * sWeight) + (cohesion * cWeight) + (alignment * aWeight);
+
+        return sfvec::clampMagnitude(velocity, topSpeed);
+    }
+
+    // Integrate a velocity into position, looping around the world when the old position was out of its dimensions
+    inline sf::Vector2f integrate(sf::Vector2f position, sf::Vector2f velocity, float deltaTime, float width, float height) {
+        sf::Vector2f newPosition = position + (velocity * deltaTime);
+
+        if (position.x > width) {
+            newPosition.x -= width;
+        }
+        else if (position.x < 0) {
+            newPosition.x += width;
+        }
+
+        if (position.y > height) {
+            newPosition.y -= height;
+        }
+        else if (position.y < 0) {
+            newPosition.y += height;
+        }
+
+        return newPosition;
+    }
+}
@@ -0,0 +1,191 @@
+#include "threadpool.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+// Pack a block range into a deque word
+static inline unsigned long long packRange(unsigned int begin, unsigned int end) {
+    return (static_cast<unsigned long long>(end) << 32) | begin;
+}
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    // Fall back to a single worker when the hardware thread count is unknown
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    this->deques = std::vector<BlockDeque>(threads);
+    this->stats.resize(threads);
+    this->workers.reserve(threads);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        this->workers.emplace_back(&ThreadPool::work, this, static_cast<int>(i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // Workers only check the stopping flag while parked, run never returns mid phase, so none are left behind
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+
+    this->wake.notify_all();
+
+    for (std::thread& t : this->workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::work(int worker) {
+    // Worker loop, parks until a new generation is published then runs its share of the phase
+
+    unsigned long long seen = 0;
+
+    profiler::nameThread("Worker " + std::to_string(worker));
+
+    for (;;) {
+        const std::function<void(int)>* current;
+
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+
+            this->wake.wait(guard, [this, seen]() {
+                return this->stopping || this->generation != seen;
+            });
+
+            if (this->stopping) {
+                return;
+            }
+
+            seen = this->generation;
+            current = this->phase;
+        }
+
+        (*current)(worker);
+
+        // Last worker to finish wakes run
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        if (--this->pending == 0) {
+            this->finished.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run(const std::function<void(int)>& phase) {
+    // Publish phase and wait for every worker to finish it
+
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    this->phase = &phase;
+    this->pending = this->size();
+    this->generation++;
+
+    this->wake.notify_all();
+
+    PROFILE_ZONE("wait");
+
+    this->finished.wait(guard, [this]() {
+        return this->pending == 0;
+    });
+
+    this->phase = nullptr;
+}
+
+int ThreadPool::popFront(int worker) {
+    // Advance begin, failing once the range is empty
+
+    std::atomic<unsigned long long>& range = this->deques[worker].range;
+    unsigned long long current = range.load(std::memory_order_relaxed);
+
+    for (;;) {
+        unsigned int begin = static_cast<unsigned int>(current);
+        unsigned int end = static_cast<unsigned int>(current >> 32);
+
+        if (begin >= end) {
+            return -1;
+        }
+
+        if (range.compare_exchange_weak(current, packRange(begin + 1, end), std::memory_order_relaxed)) {
+            return static_cast<int>(begin);
+        }
+    }
+}
+
+int ThreadPool::popBack(int victim) {
+    // Retreat end, failing once the range is empty
+
+    std::atomic<unsigned long long>& range = this->deques[victim].range;
+    unsigned long long current = range.load(std::memory_order_relaxed);
+
+    for (;;) {
+        unsigned int begin = static_cast<unsigned int>(current);
+        unsigned int end = static_cast<unsigned int>(current >> 32);
+
+        if (begin >= end) {
+            return -1;
+        }
+
+        if (range.compare_exchange_weak(current, packRange(begin, end - 1), std::memory_order_relaxed)) {
+            return static_cast<int>(end - 1);
+        }
+    }
+}
+
+void ThreadPool::drain(int worker, const std::function<void(int)>& task) {
+    // Blocks are never added during a phase, so one sweep over the victims empties every deque
+
+    WorkerStats& s = this->stats[worker];
+    int block;
+
+    while ((block = this->popFront(worker)) >= 0) {
+        task(block);
+        s.blocks++;
+    }
+
+    for (int k = 1; k < this->size(); k++) {
+        int victim = (worker + k) % this->size();
+
+        while ((block = this->popBack(victim)) >= 0) {
+            task(block);
+            s.blocks++;
+            s.steals++;
+        }
+    }
+
+    s.finish = std::chrono::steady_clock::now();
+}
+
+void ThreadPool::runBlocks(int blocks, const std::function<void(int)>& task) {
+    // Deal blocks out in contiguous runs, the mutex in run publishes the deques to the workers
+
+    int workers = this->size();
+
+    for (int w = 0; w < workers; w++) {
+        unsigned int begin = static_cast<unsigned int>(static_cast<long long>(blocks) * w / workers);
+        unsigned int end = static_cast<unsigned int>(static_cast<long long>(blocks) * (w + 1) / workers);
+
+        this->deques[w].range.store(packRange(begin, end), std::memory_order_relaxed);
+    }
+
+    this->run([this, &task](int worker) {
+        this->drain(worker, task);
+    });
+
+    // Time between each worker running dry and the last worker finishing is idle
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    for (WorkerStats& s : this->stats) {
+        s.idle += std::chrono::duration<double>(end - s.finish).count();
+    }
+}
+
+void ThreadPool::resetStats() {
+    // Clear counters, workers are parked so nothing writes to them concurrently
+
+    for (WorkerStats& s : this->stats) {
+        s = WorkerStats();
+    }
+}
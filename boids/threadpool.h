@@ -0,0 +1,92 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Per worker scheduling counters, padded so workers never write to the same cache line
+struct alignas(64) WorkerStats {
+    // Blocks executed, and how many of those were stolen from other workers' deques
+    unsigned long long blocks = 0;
+    unsigned long long steals = 0;
+
+    // Seconds spent waiting for other workers to finish block phases
+    double idle = 0;
+
+    // When this worker ran out of blocks in the current block phase
+    std::chrono::steady_clock::time_point finish;
+};
+
+// Fixed set of worker threads that live as long as the pool
+// Workers park on a condition variable between phases, each run call wakes all of them once to execute one phase
+// and blocks until every worker has finished it, so phases act as barriers without creating threads per frame
+class ThreadPool {
+private:
+    // Range of block indices still queued on one worker, packed as (end << 32 | begin) so both ends move with a single CAS
+    // The owner takes blocks from the front, thieves take them from the back
+    struct alignas(64) BlockDeque {
+        std::atomic<unsigned long long> range = 0;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<BlockDeque> deques;
+    std::vector<WorkerStats> stats;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    // Phase being executed, only valid while run is blocked waiting for it
+    const std::function<void(int)>* phase = nullptr;
+
+    // Incremented by every run call, workers compare it to the last phase they executed to detect new work
+    unsigned long long generation = 0;
+
+    // Workers yet to finish the current phase
+    int pending = 0;
+
+    bool stopping = false;
+
+    void work(int worker);
+
+    // Take a block from the front of worker's own deque or the back of a victim's deque, -1 when it is empty
+    int popFront(int worker);
+    int popBack(int victim);
+
+    // Run own blocks, then steal from every other worker until all deques are empty
+    void drain(int worker, const std::function<void(int)>& task);
+
+public:
+    // Start `threads` workers, 0 uses one per hardware thread
+    explicit ThreadPool(unsigned int threads = 0);
+
+    // Disable copy and move, workers hold a pointer to the pool
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    // Wake all workers to exit and join them
+    ~ThreadPool();
+
+    int size() const {
+        return static_cast<int>(this->workers.size());
+    }
+
+    // Call phase(worker) on every worker, worker ranging from 0 to size() - 1, and wait for all calls to return
+    void run(const std::function<void(int)>& phase);
+
+    // Call task(block) once for every block from 0 to blocks - 1 and wait for all calls to return
+    // Blocks are dealt out to per-worker deques in contiguous runs, workers that empty their own deque steal from others,
+    // so uneven block costs do not leave the phase waiting on one overloaded worker
+    void runBlocks(int blocks, const std::function<void(int)>& task);
+
+    // Scheduling counters accumulated since construction or the last resetStats
+    const WorkerStats& workerStats(int worker) const {
+        return this->stats[worker];
+    }
+
+    void resetStats();
+};
@@ -0,0 +1,426 @@
+#include "trajectory.h"
+#include "sfvec.h"
+
+#include <cstring>
+#include <climits>
+
+#ifdef BOIDS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+    const char magic[8] = { 'B', 'O', 'I', 'D', 'T', 'R', 'A', 'J' };
+    const std::uint32_t byteOrder = 0x01020304;
+
+#ifdef BOIDS_ZSTD
+    // Fast zstd level, the writer has to keep up with the simulation
+    const int compressionLevel = 1;
+#endif
+
+    // Bytes of a frame's step and boid count before its columns
+    const std::size_t frameHeaderBytes = sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+    // Longest varint of a 32 bit value
+    const std::size_t maxVarintBytes = 5;
+
+    // Map signed deltas to unsigned so small magnitudes of either sign code to few bytes
+    std::uint32_t zigzag(std::int32_t value) {
+        return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+    }
+
+    std::int32_t unzigzag(std::uint32_t value) {
+        return static_cast<std::int32_t>(value >> 1) ^ -static_cast<std::int32_t>(value & 1);
+    }
+
+    // Little endian base 128, 7 bits per byte with the high bit set on every byte but the last
+    unsigned char* putVarint(unsigned char* out, std::uint32_t value) {
+        while (value >= 0x80) {
+            *out++ = static_cast<unsigned char>(value | 0x80);
+            value >>= 7;
+        }
+
+        *out++ = static_cast<unsigned char>(value);
+        return out;
+    }
+
+    // Read a varint, false if it runs past end or over 32 bits
+    bool getVarint(const unsigned char*& in, const unsigned char* end, std::uint32_t& value) {
+        value = 0;
+
+        for (int shift = 0; shift < 35 && in < end; shift += 7) {
+            unsigned char byte = *in++;
+            value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Nearest multiple of 1 / scale as a fixed point integer, saturating outside the int32 range
+    std::int32_t quantize(float value, double scale) {
+        double scaled = std::clamp(static_cast<double>(value) * scale, static_cast<double>(INT_MIN), static_cast<double>(INT_MAX));
+
+        return static_cast<std::int32_t>(sfvec::roundNearest(scaled));
+    }
+
+    // Code count values as deltas from the previous frame's fixed point values, boids the previous frame did not have
+    // (all of them at a key frame) are coded against zero. Deltas wrap in 32 bits so no difference overflows
+    unsigned char* encodeColumn(unsigned char* out, const float* values, std::int32_t* previous, int count, int known, double scale) {
+        for (int i = 0; i < count; i++) {
+            std::int32_t current = quantize(values[i], scale);
+            std::uint32_t base = i < known ? static_cast<std::uint32_t>(previous[i]) : 0;
+
+            out = putVarint(out, zigzag(static_cast<std::int32_t>(static_cast<std::uint32_t>(current) - base)));
+            previous[i] = current;
+        }
+
+        return out;
+    }
+
+    bool decodeColumn(const unsigned char*& in, const unsigned char* end, float* values, std::int32_t* previous, int count, int known, float quantum) {
+        for (int i = 0; i < count; i++) {
+            std::uint32_t delta;
+
+            if (!getVarint(in, end, delta)) {
+                return false;
+            }
+
+            std::uint32_t base = i < known ? static_cast<std::uint32_t>(previous[i]) : 0;
+            previous[i] = static_cast<std::int32_t>(base + static_cast<std::uint32_t>(unzigzag(delta)));
+            values[i] = previous[i] * quantum;
+        }
+
+        return true;
+    }
+
+    // Leader flags packed 8 per byte and XORed with the previous frame's, so only changes set bits
+    unsigned char* encodeLeaders(unsigned char* out, const std::uint8_t* leader, std::uint8_t* previous, int count, int known) {
+        std::memset(out, 0, (count + 7) / 8);
+
+        for (int i = 0; i < count; i++) {
+            std::uint8_t flag = leader[i] != 0;
+            std::uint8_t base = i < known ? previous[i] : 0;
+
+            out[i / 8] |= (flag ^ base) << (i % 8);
+            previous[i] = flag;
+        }
+
+        return out + (count + 7) / 8;
+    }
+
+    bool decodeLeaders(const unsigned char*& in, const unsigned char* end, std::uint8_t* leader, std::uint8_t* previous, int count, int known) {
+        if (static_cast<std::size_t>(end - in) < static_cast<std::size_t>(count + 7) / 8) {
+            return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            std::uint8_t base = i < known ? previous[i] : 0;
+
+            previous[i] = base ^ ((in[i / 8] >> (i % 8)) & 1);
+            leader[i] = previous[i];
+        }
+
+        in += (count + 7) / 8;
+        return true;
+    }
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path, float positionQuantum, float velocityQuantum, int chunkFrames, bool compress, std::size_t depth) :
+    frames(make_channel<TrajectoryFrame>(depth)), spares(make_channel<TrajectoryFrame>()) {
+    // Write the file header, then start the writer
+
+#ifdef BOIDS_ZSTD
+    this->compress = compress;
+#else
+    // Without zstd every chunk is stored as encoded
+    (void)compress;
+#endif
+
+    this->header = {};
+    std::memcpy(this->header.magic, magic, sizeof(magic));
+    this->header.version = trajectory::version;
+    this->header.byteOrder = byteOrder;
+    this->header.positionQuantum = positionQuantum;
+    this->header.velocityQuantum = velocityQuantum;
+    this->header.chunkFrames = std::max(chunkFrames, 1);
+
+    this->file = std::fopen(path.c_str(), "wb");
+
+    if (!this->file || std::fwrite(&this->header, sizeof(this->header), 1, this->file) != 1) {
+        this->failed = true;
+    }
+
+    this->writer = std::thread(&TrajectoryRecorder::run, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    this->close();
+}
+
+void TrajectoryRecorder::record(Flock& flock) {
+    // Copy the step's arrays into a recycled frame, the only recording work done on the simulation thread
+    // A step left running on a device is not waited for, the step published before it is recorded instead
+
+    std::uint64_t step = flock.readBack(false);
+
+    PROFILE_ZONE("record");
+
+    TrajectoryFrame frame = this->spares.second.tryRead().value_or(TrajectoryFrame());
+    frame.resize(flock.size);
+    frame.step = step;
+
+    std::memcpy(frame.x.data(), flock.state.x.data(), flock.size * sizeof(float));
+    std::memcpy(frame.y.data(), flock.state.y.data(), flock.size * sizeof(float));
+    std::memcpy(frame.vx.data(), flock.state.vx.data(), flock.size * sizeof(float));
+    std::memcpy(frame.vy.data(), flock.state.vy.data(), flock.size * sizeof(float));
+    std::memcpy(frame.leader.data(), flock.state.leader.data(), flock.size * sizeof(std::uint8_t));
+
+    // Blocks while the writer is depth frames behind, fails once closed
+    this->frames.first.write(std::move(frame));
+}
+
+void TrajectoryRecorder::run() {
+    // Encode frames until the channel is closed and drained, then write the last partial chunk
+
+    profiler::nameThread("Recorder");
+
+    while (std::optional<TrajectoryFrame> frame = this->frames.second.read()) {
+        if (!this->failed) {
+            this->encode(*frame);
+        }
+
+        this->spares.first.write(std::move(*frame));
+    }
+
+    if (this->chunkFrames && !this->failed) {
+        this->writeChunk();
+    }
+}
+
+void TrajectoryRecorder::encode(const TrajectoryFrame& frame) {
+    // Code the frame against the previous one in the chunk, the chunk's first frame is a key frame
+
+    PROFILE_ZONE("encode");
+
+    if (!this->chunkFrames) {
+        this->firstStep = frame.step;
+        this->coder.known = 0;
+    }
+
+    int count = frame.size;
+    this->coder.resize(count);
+
+    // Grow the chunk to the frame's worst case size, then trim it to what was written
+    std::size_t start = this->chunk.size();
+    this->chunk.resize(start + frameHeaderBytes + count * 4 * maxVarintBytes + (count + 7) / 8);
+
+    unsigned char* out = this->chunk.data() + start;
+    std::uint32_t boids = count;
+
+    std::memcpy(out, &frame.step, sizeof(std::uint64_t));
+    std::memcpy(out + sizeof(std::uint64_t), &boids, sizeof(std::uint32_t));
+    out += frameHeaderBytes;
+
+    double positionScale = 1.0 / this->header.positionQuantum;
+    double velocityScale = 1.0 / this->header.velocityQuantum;
+    int known = this->coder.known;
+
+    out = encodeColumn(out, frame.x.data(), this->coder.x.data(), count, known, positionScale);
+    out = encodeColumn(out, frame.y.data(), this->coder.y.data(), count, known, positionScale);
+    out = encodeColumn(out, frame.vx.data(), this->coder.vx.data(), count, known, velocityScale);
+    out = encodeColumn(out, frame.vy.data(), this->coder.vy.data(), count, known, velocityScale);
+    out = encodeLeaders(out, frame.leader.data(), this->coder.leader.data(), count, known);
+
+    this->chunk.resize(out - this->chunk.data());
+    this->coder.known = count;
+    this->chunkFrames++;
+
+    {
+        std::lock_guard<std::mutex> lock(this->statsLock);
+        this->counters.frames++;
+        this->counters.rawBytes += count * (4 * sizeof(float) + sizeof(std::uint8_t));
+    }
+
+    if (this->chunkFrames >= this->header.chunkFrames) {
+        this->writeChunk();
+    }
+}
+
+void TrajectoryRecorder::writeChunk() {
+    // Compress the chunk if enabled and append it to the file, the next frame starts a new chunk
+
+    PROFILE_ZONE("write");
+
+    trajectory::ChunkHeader chunkHeader = {};
+    chunkHeader.frames = this->chunkFrames;
+    chunkHeader.codec = trajectory::Stored;
+    chunkHeader.encodedBytes = this->chunk.size();
+    chunkHeader.storedBytes = this->chunk.size();
+    chunkHeader.firstStep = this->firstStep;
+
+    const unsigned char* payload = this->chunk.data();
+
+#ifdef BOIDS_ZSTD
+    if (this->compress) {
+        this->stored.resize(ZSTD_compressBound(this->chunk.size()));
+        std::size_t bytes = ZSTD_compress(this->stored.data(), this->stored.size(), this->chunk.data(), this->chunk.size(), compressionLevel);
+
+        // Chunks that do not shrink are stored as encoded
+        if (!ZSTD_isError(bytes) && bytes < this->chunk.size()) {
+            chunkHeader.codec = trajectory::Zstd;
+            chunkHeader.storedBytes = bytes;
+            payload = this->stored.data();
+        }
+    }
+#endif
+
+    bool written = std::fwrite(&chunkHeader, sizeof(chunkHeader), 1, this->file) == 1 &&
+        std::fwrite(payload, 1, chunkHeader.storedBytes, this->file) == chunkHeader.storedBytes;
+
+    if (!written) {
+        this->failed = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->statsLock);
+        this->counters.chunks++;
+        this->counters.encodedBytes += chunkHeader.encodedBytes;
+        this->counters.storedBytes += sizeof(chunkHeader) + chunkHeader.storedBytes;
+    }
+
+    this->chunk.clear();
+    this->chunkFrames = 0;
+}
+
+bool TrajectoryRecorder::close() {
+    // Let the writer drain the queue, then close the file
+
+    if (this->writer.joinable()) {
+        this->frames.first.close();
+        this->writer.join();
+    }
+
+    if (this->file) {
+        if (std::fclose(this->file) != 0) {
+            this->failed = true;
+        }
+
+        this->file = nullptr;
+    }
+
+    return !this->failed;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string& path) :
+    file(path, std::ios::binary) {
+    // Read and validate the file header
+
+    this->valid = this->file.read(reinterpret_cast<char*>(&this->header), sizeof(this->header)) &&
+        std::memcmp(this->header.magic, magic, sizeof(magic)) == 0 && this->header.version == trajectory::version &&
+        this->header.byteOrder == byteOrder && this->header.positionQuantum > 0 && this->header.velocityQuantum > 0;
+}
+
+bool TrajectoryReader::readChunk() {
+    // Read the next chunk's payload, decompressing it if needed
+
+    trajectory::ChunkHeader chunkHeader;
+
+    if (!this->file.read(reinterpret_cast<char*>(&chunkHeader), sizeof(chunkHeader)) || !chunkHeader.frames) {
+        return false;
+    }
+
+    // Sizes come from the file, check them against what remains of it before allocating
+    std::streampos here = this->file.tellg();
+    this->file.seekg(0, std::ios::end);
+    std::uint64_t left = static_cast<std::uint64_t>(this->file.tellg() - here);
+    this->file.seekg(here);
+
+    if (chunkHeader.storedBytes > left) {
+        return false;
+    }
+
+    this->stored.resize(chunkHeader.storedBytes);
+
+    if (!this->file.read(reinterpret_cast<char*>(this->stored.data()), chunkHeader.storedBytes)) {
+        return false;
+    }
+
+    if (chunkHeader.codec == trajectory::Stored) {
+        std::swap(this->chunk, this->stored);
+    }
+#ifdef BOIDS_ZSTD
+    else if (chunkHeader.codec == trajectory::Zstd) {
+        unsigned long long bytes = ZSTD_getFrameContentSize(this->stored.data(), this->stored.size());
+
+        if (bytes != chunkHeader.encodedBytes) {
+            return false;
+        }
+
+        this->chunk.resize(bytes);
+
+        if (ZSTD_decompress(this->chunk.data(), this->chunk.size(), this->stored.data(), this->stored.size()) != bytes) {
+            return false;
+        }
+    }
+#endif
+    else {
+        // Compressed by a build with zstd, or corrupt
+        return false;
+    }
+
+    this->position = 0;
+    this->remaining = chunkHeader.frames;
+    this->coder.known = 0;
+
+    return true;
+}
+
+bool TrajectoryReader::next(TrajectoryFrame& frame) {
+    // Decode the next frame of the current chunk, reading a new chunk once it is used up
+
+    if (!this->valid || (!this->remaining && !this->readChunk())) {
+        return false;
+    }
+
+    const unsigned char* in = this->chunk.data() + this->position;
+    const unsigned char* end = this->chunk.data() + this->chunk.size();
+
+    if (static_cast<std::size_t>(end - in) < frameHeaderBytes) {
+        return false;
+    }
+
+    std::uint32_t boids;
+    std::memcpy(&frame.step, in, sizeof(std::uint64_t));
+    std::memcpy(&boids, in + sizeof(std::uint64_t), sizeof(std::uint32_t));
+    in += frameHeaderBytes;
+
+    // Every boid takes at least a byte per value, so a count larger than the rest of the chunk is corrupt
+    if (boids > static_cast<std::size_t>(end - in)) {
+        return false;
+    }
+
+    int count = boids;
+    int known = this->coder.known;
+
+    frame.resize(count);
+    this->coder.resize(count);
+
+    bool decoded = decodeColumn(in, end, frame.x.data(), this->coder.x.data(), count, known, this->header.positionQuantum) &&
+        decodeColumn(in, end, frame.y.data(), this->coder.y.data(), count, known, this->header.positionQuantum) &&
+        decodeColumn(in, end, frame.vx.data(), this->coder.vx.data(), count, known, this->header.velocityQuantum) &&
+        decodeColumn(in, end, frame.vy.data(), this->coder.vy.data(), count, known, this->header.velocityQuantum) &&
+        decodeLeaders(in, end, frame.leader.data(), this->coder.leader.data(), count, known);
+
+    if (!decoded) {
+        return false;
+    }
+
+    this->position = in - this->chunk.data();
+    this->remaining--;
+    this->coder.known = count;
+
+    return true;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "flocks.h"
+#include "channel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-step trajectories streamed to a file for offline analysis
+// The simulation thread only copies each step's positions, velocities and leader flags into a recycled frame, a writer
+// thread encodes and writes them. Values are quantized to fixed point and coded as the zigzag varint difference from the
+// boid's previous frame, leader flags as a bitset XORed with the previous frame's, so slowly changing boids take 1 or 2 bytes
+// per value. Frames are grouped into chunks that start on a key frame coded against zero, so each chunk decodes on its own
+// Chunks are zstd compressed when built with BOIDS_ZSTD, otherwise stored as encoded
+namespace trajectory {
+    // Format version, bumped whenever the file, chunk or frame layout changes
+    const std::uint32_t version = 1;
+
+    // Chunk payload codecs
+    enum Codec : std::uint32_t {
+        Stored = 0,
+        Zstd = 1
+    };
+
+    // File header, every field has a fixed width so the layout does not depend on the compiler
+    struct Header {
+        // "BOIDTRAJ"
+        char magic[8];
+        std::uint32_t version;
+
+        // 0x01020304 as written, recordings from a machine of the other byte order are rejected
+        std::uint32_t byteOrder;
+
+        // Spacing of the fixed point grids positions and velocities are rounded to
+        float positionQuantum;
+        float velocityQuantum;
+
+        // Frames per chunk, the last chunk may hold fewer
+        std::uint32_t chunkFrames;
+        std::uint32_t reserved;
+    };
+
+    // Precedes every chunk's payload
+    struct ChunkHeader {
+        std::uint32_t frames;
+        std::uint32_t codec;
+
+        // Payload size once decompressed and as stored in the file
+        std::uint64_t encodedBytes;
+        std::uint64_t storedBytes;
+
+        // Step of the chunk's key frame
+        std::uint64_t firstStep;
+    };
+}
+
+// One step's recorded boids, arrays are indexed by boid id
+struct TrajectoryFrame {
+    // Step the frame was recorded after
+    std::uint64_t step = 0;
+
+    int size = 0;
+
+    // Position
+    std::vector<float> x;
+    std::vector<float> y;
+
+    // Velocity
+    std::vector<float> vx;
+    std::vector<float> vy;
+
+    std::vector<std::uint8_t> leader;
+
+    // Size arrays for count boids, only growing so recycled frames do not reallocate
+    void resize(int count) {
+        this->size = count;
+
+        if (static_cast<int>(this->x.size()) < count) {
+            this->x.resize(count);
+            this->y.resize(count);
+            this->vx.resize(count);
+            this->vy.resize(count);
+            this->leader.resize(count);
+        }
+    }
+};
+
+// Recorded volume, raw bytes are the frames' unquantized values
+struct RecorderStats {
+    std::uint64_t frames = 0;
+    std::uint64_t chunks = 0;
+    std::uint64_t rawBytes = 0;
+    std::uint64_t encodedBytes = 0;
+    std::uint64_t storedBytes = 0;
+};
+
+// Quantized delta coding state of one side of a stream, the previous frame's fixed point values
+struct TrajectoryCoder {
+    std::vector<std::int32_t> x;
+    std::vector<std::int32_t> y;
+    std::vector<std::int32_t> vx;
+    std::vector<std::int32_t> vy;
+    std::vector<std::uint8_t> leader;
+
+    // Boids in the previous frame of the current chunk, 0 at a key frame
+    int known = 0;
+
+    void resize(int count) {
+        if (static_cast<int>(this->x.size()) < count) {
+            this->x.resize(count);
+            this->y.resize(count);
+            this->vx.resize(count);
+            this->vy.resize(count);
+            this->leader.resize(count);
+        }
+    }
+};
+
+// Records a flock's steps to a trajectory file on a background writer thread
+// Frames pass through a bounded channel, a writer depth frames behind stalls record so memory use stays bounded
+// Written frames are handed back through a second channel and refilled, so steady state recording does not allocate
+class TrajectoryRecorder {
+private:
+    std::FILE* file = nullptr;
+
+    trajectory::Header header;
+
+    // Compress chunks, only possible in builds with BOIDS_ZSTD
+    bool compress = false;
+
+    // Recorded frames (simulation to writer) and written ones returned for reuse (writer to simulation)
+    std::pair<Channel<TrajectoryFrame>, Channel<TrajectoryFrame>> frames;
+    std::pair<Channel<TrajectoryFrame>, Channel<TrajectoryFrame>> spares;
+
+    // Writer thread state, the current chunk's encoded frames and its compressed form
+    TrajectoryCoder coder;
+    std::vector<unsigned char> chunk;
+    std::vector<unsigned char> stored;
+    std::uint32_t chunkFrames = 0;
+    std::uint64_t firstStep = 0;
+
+    // Set once a write fails, later frames are dropped
+    std::atomic<bool> failed = false;
+
+    RecorderStats counters;
+    mutable std::mutex statsLock;
+
+    std::thread writer;
+
+    // Writer thread loop
+    void run();
+
+    // Append a frame to the current chunk, writing the chunk once full
+    void encode(const TrajectoryFrame& frame);
+    void writeChunk();
+
+public:
+    // Start recording to path, replacing any existing file
+    // Positions and velocities are rounded to multiples of their quanta, so decoded values are within half a quantum
+    // chunkFrames is the key frame interval, depth the number of frames the simulation may run ahead of the writer
+    TrajectoryRecorder(const std::string& path, float positionQuantum = 1 / 64.f, float velocityQuantum = 1 / 64.f,
+        int chunkFrames = 60, bool compress = true, std::size_t depth = 4);
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    ~TrajectoryRecorder();
+
+    // Whether the file was opened and every chunk so far was written
+    bool good() const {
+        return this->file && !this->failed;
+    }
+
+    // Copy the flock's current step into a frame and queue it for the writer, call after each update
+    // Engines stepping elsewhere are read back first, an overlapped GPUFlock's frames are then one step behind its updates
+    void record(Flock& flock);
+
+    // Write out every queued frame and the last partial chunk and close the file, further records are ignored
+    // Returns good()
+    bool close();
+
+    RecorderStats stats() const {
+        std::lock_guard<std::mutex> lock(this->statsLock);
+
+        return this->counters;
+    }
+
+    // Queue depth and stalls, write stalls are steps that waited on the writer
+    ChannelStats queueStats() const {
+        return this->frames.second.stats();
+    }
+};
+
+// Reads a trajectory file back frame by frame
+class TrajectoryReader {
+private:
+    std::ifstream file;
+
+    trajectory::Header header = {};
+    bool valid = false;
+
+    // Current chunk's decoded payload, read position and frames left
+    TrajectoryCoder coder;
+    std::vector<unsigned char> chunk;
+    std::vector<unsigned char> stored;
+    std::size_t position = 0;
+    std::uint32_t remaining = 0;
+
+    bool readChunk();
+
+public:
+    explicit TrajectoryReader(const std::string& path);
+
+    // Whether the file is a trajectory of this version
+    bool good() const {
+        return this->valid;
+    }
+
+    float positionQuantum() const {
+        return this->header.positionQuantum;
+    }
+
+    float velocityQuantum() const {
+        return this->header.velocityQuantum;
+    }
+
+    // Decode the next frame into frame, false at the end of the file or on a corrupt or unreadable chunk
+    bool next(TrajectoryFrame& frame);
+};
@@ -0,0 +1,186 @@
+#include "boid.h"
+#include "flocks.h"
+#include "checkpoint.h"
+#include "trajectory.h"
+#include "arguments.h"
+
+#include <string>
+#include <map>
+#include <fstream>
+
+// Reads a trajectory recording back, summarizing it, optionally dumping every frame as CSV for offline analysis
+// and checking the frame recorded at a checkpoint's step against the checkpointed flock
+// Usage: boids-trajectory --trajectory file [--csv file, one row per boid per frame]
+//                         [--checkpoint file, saved at a recorded step, like boids-headless's final step]
+// Exits with 1 if the recording could not be read or the checkpoint check failed
+struct TrajectoryConfig {
+    std::string trajectory;
+    std::string csv;
+    std::string checkpoint;
+};
+
+bool parseArguments(int argc, char* argv[], TrajectoryConfig& config) {
+    // Read `--key value` pairs, returning false on unknown keys or missing values
+
+    std::optional<std::map<std::string, std::string>> values = arguments::parse(argc, argv);
+
+    if (!values) {
+        return false;
+    }
+
+    for (const std::pair<const std::string, std::string>& value : *values) {
+        const std::string& key = value.first;
+        const std::string& v = value.second;
+
+        if (key == "trajectory") {
+            config.trajectory = v;
+        }
+        else if (key == "csv") {
+            config.csv = v;
+        }
+        else if (key == "checkpoint") {
+            config.checkpoint = v;
+        }
+        else {
+            std::cerr << "Unknown option: --" << key << "\n";
+            return false;
+        }
+    }
+
+    if (config.trajectory.empty()) {
+        std::cerr << "Invalid configuration\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    TrajectoryConfig config;
+
+    if (!parseArguments(argc, argv, config)) {
+        return 1;
+    }
+
+    TrajectoryReader reader(config.trajectory);
+
+    if (!reader.good()) {
+        std::cerr << "Invalid or unreadable trajectory: " << config.trajectory << "\n";
+        return 1;
+    }
+
+    // Checkpointed flock the frame at its step is checked against
+    std::optional<checkpoint::Header> header;
+    std::unique_ptr<Flock> flock;
+
+    if (!config.checkpoint.empty()) {
+        header = checkpoint::inspect(config.checkpoint);
+
+        if (header) {
+            std::mt19937 gen;
+
+            flock = std::make_unique<Flock>([](int) {
+                return Boid();
+            }, 0, 2.f, 0.25f, 0.25f, gen, sf::Vector2u(header->width, header->height));
+        }
+
+        if (!header || !checkpoint::load(*flock, config.checkpoint)) {
+            std::cerr << "Invalid or unreadable checkpoint: " << config.checkpoint << "\n";
+            return 1;
+        }
+    }
+
+    std::ofstream csv;
+
+    if (!config.csv.empty()) {
+        csv.open(config.csv);
+        csv << "step,boid,x,y,vx,vy,leader\n";
+
+        if (!csv) {
+            std::cerr << "Could not write CSV: " << config.csv << "\n";
+            return 1;
+        }
+    }
+
+    // Decoded values are within half a quantum of the recorded ones
+    float positionTolerance = reader.positionQuantum() / 2;
+    float velocityTolerance = reader.velocityQuantum() / 2;
+
+    TrajectoryFrame frame;
+    std::uint64_t frames = 0;
+    std::uint64_t firstStep = 0;
+    std::uint64_t lastStep = 0;
+    std::uint64_t gaps = 0;
+    int fewestBoids = 0;
+    int mostBoids = 0;
+
+    // Largest differences from the checkpoint, set once its step's frame is found
+    bool checked = false;
+    bool matched = false;
+    bool countsDiffered = false;
+    float positionError = 0;
+    float velocityError = 0;
+    int leaderErrors = 0;
+
+    while (reader.next(frame)) {
+        if (frames == 0) {
+            firstStep = frame.step;
+            fewestBoids = frame.size;
+        }
+        else if (frame.step != lastStep + 1) {
+            gaps++;
+        }
+
+        frames++;
+        lastStep = frame.step;
+        fewestBoids = std::min(fewestBoids, frame.size);
+        mostBoids = std::max(mostBoids, frame.size);
+
+        if (csv.is_open()) {
+            for (int i = 0; i < frame.size; i++) {
+                csv << frame.step << "," << i << "," << frame.x[i] << "," << frame.y[i] << "," <<
+                    frame.vx[i] << "," << frame.vy[i] << "," << static_cast<int>(frame.leader[i]) << "\n";
+            }
+        }
+
+        if (!flock || frame.step != flock->step) {
+            continue;
+        }
+
+        checked = true;
+        countsDiffered = frame.size != flock->size;
+        matched = !countsDiffered;
+
+        for (int i = 0; matched && i < frame.size; i++) {
+            positionError = std::max({ positionError, std::fabs(frame.x[i] - flock->state.x[i]), std::fabs(frame.y[i] - flock->state.y[i]) });
+            velocityError = std::max({ velocityError, std::fabs(frame.vx[i] - flock->state.vx[i]), std::fabs(frame.vy[i] - flock->state.vy[i]) });
+            leaderErrors += frame.leader[i] != flock->state.leader[i];
+        }
+
+        matched = matched && positionError <= positionTolerance && velocityError <= velocityTolerance && !leaderErrors;
+    }
+
+    if (csv.is_open() && !csv.flush()) {
+        std::cerr << "Could not write CSV: " << config.csv << "\n";
+        return 1;
+    }
+
+    std::cout << "Frames: " << frames << ", Steps: " << firstStep << "-" << lastStep << " (" << gaps << " gaps), Boids: " <<
+        fewestBoids << "-" << mostBoids << ", Quanta, Position: " << reader.positionQuantum() << ", Velocity: " <<
+        reader.velocityQuantum() << "\n";
+
+    if (!flock) {
+        return 0;
+    }
+
+    if (!checked) {
+        std::cout << "No frame was recorded at the checkpoint's step " << flock->step << "\n";
+        return 1;
+    }
+
+    std::cout << "Frame at step " << flock->step << (matched ? " matched" : " differed from") << " the checkpoint, Largest differences, Position: " <<
+        positionError << ", Velocity: " << velocityError << ", Leaders: " << leaderErrors <<
+        (countsDiffered ? ", boid counts differed" : "") << "\n";
+
+    return matched ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#include "boid.h"
+#include "flocks.h"
+
+#include <string>
+
+// Regression test: every engine must keep stepping after all of its boids are removed, and step again once boids are added back
+// Exits with 1 naming the first engine that lost its step count or boids
+bool check(const std::string& name, Flock& flock, const Boid& boid) {
+    // Step, remove every boid, step the empty flock, then add boids back and step them
+
+    flock.update(1 / 60.);
+
+    while (flock.size) {
+        flock.remove(flock.size - 1);
+    }
+
+    std::uint64_t step = flock.step;
+
+    for (int s = 0; s < 3; s++) {
+        flock.update(1 / 60.);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        flock.add(boid);
+    }
+
+    flock.update(1 / 60.);
+    flock.synchronize();
+
+    bool passed = flock.size == 5 && flock.step == step + 4;
+
+    for (int i = 0; passed && i < flock.size; i++) {
+        passed = flock.state.radius[i] == boid.radius && flock.state.topSpeed[i] > 0;
+    }
+
+    if (!passed) {
+        std::cerr << name << ": Size: " << flock.size << ", Step: " << flock.step << ", expected 5 boids at step " << step + 4 << "\n";
+    }
+
+    return passed;
+}
+
+int main() {
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> rand_x(0, 640);
+    std::uniform_real_distribution<float> rand_y(0, 480);
+    std::uniform_real_distribution<float> rand_v(-200, 200);
+
+    auto dna = [&rand_x, &rand_y, &rand_v, &gen](int) {
+        return Boid(rand_x(gen), rand_y(gen), 5.f, 200.f, sf::Vector2f(rand_v(gen), rand_v(gen)), 15.f);
+    };
+
+    sf::Vector2u dimensions(640, 480);
+    Boid boid = dna(0);
+
+    Flock sequential(dna, 40, 2.f, 0.25f, 0.25f, gen, dimensions);
+    NaiveCPUFlock naive(dna, 40, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, 2);
+    CPUFlock chunked(dna, 40, 2.f, 0.25f, 0.25f, gen, dimensions, nullptr, 3);
+
+    bool passed = check("seq", sequential, boid);
+    passed = check("naivecpu", naive, boid) && passed;
+    passed = check("cpu", chunked, boid) && passed;
+
+#ifdef BOIDS_SYCL
+    GPUFlock device(dna, 40, 2.f, 0.25f, 0.25f, gen, dimensions);
+    device.setDevice(sycl::device(sycl::default_selector_v));
+    passed = check("sycl", device, boid) && passed;
+#endif
+
+    return passed ? 0 : 1;
+}